@@ -0,0 +1,145 @@
+#include "completion.h"
+#include "search.h"
+#include "wordIndex.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std::literals;
+
+std::vector<std::pair<std::string, unsigned>> completePrefix(const Corpus& corpus, const std::string& prefix, unsigned limit)
+{
+    const std::vector<std::pair<unsigned, unsigned>> prefixWords(findWords(prefix));
+    std::vector<std::string> context;
+    for (const auto& [i_word, n_word] : prefixWords)
+        context.push_back(normalizeWord(std::string_view(prefix).substr(i_word, n_word)));
+
+    std::string stem;
+    if (!context.empty() && prefixWords.back().first + prefixWords.back().second == std::size(prefix))
+    {
+        stem = std::move(context.back());
+        context.pop_back();
+    }
+
+    if ((context.empty() && stem.empty()) || !corpus.wordIndex)
+        return {};
+
+    std::map<std::string, unsigned> counts;
+    for (const SubtitlesFile& file : corpus.files)
+    {
+        const WordIndex& index(*file.words);
+        if (context.empty())
+        {
+            const auto it_begin(std::lower_bound(std::cbegin(index.sortedIds), std::cend(index.sortedIds), stem, [&](unsigned id, const std::string& word){ return index.words[id] < word; }));
+            for (auto it(it_begin); it != std::cend(index.sortedIds) && index.words[*it].compare(0, std::size(stem), stem) == 0; ++it)
+                counts[index.words[*it]] += index.episodes[*it];
+
+            continue;
+        }
+
+        // The rarest word of the context anchors the occurrences of the context
+        std::vector<unsigned> ids;
+        for (const std::string& word : context)
+            if (const auto it_id(index.ids.find(word)); it_id != std::end(index.ids))
+                ids.push_back(it_id->second);
+
+        if (std::size(ids) != std::size(context))
+            continue;
+
+        const unsigned
+            n_context = unsigned(std::size(context)),
+            j_anchor = unsigned(std::min_element(std::cbegin(ids), std::cend(ids), [&](unsigned lhs, unsigned rhs){ return std::size(index.postings[lhs]) < std::size(index.postings[rhs]); }) - std::cbegin(ids));
+
+        // The other words of an occurrence are looked up by where they'd be, each posting list being in the order of the episodes, their subtitles and words
+        std::unordered_map<const Episode*, unsigned> episodeOrder;
+        for (const Episode& episode : *file.episodes)
+            episodeOrder.emplace(&episode, unsigned(std::size(episodeOrder)));
+
+        const auto position([&](const WordIndex::Posting& posting){ return std::make_tuple(episodeOrder[posting.episode], posting.i_subtitle, posting.i_word); });
+        const auto find([&](unsigned j, const WordIndex::Posting& anchor, unsigned i_word) -> const WordIndex::Posting*
+        {
+            const std::vector<WordIndex::Posting>& postings(index.postings[ids[j]]);
+            const auto at(std::make_tuple(episodeOrder[anchor.episode], anchor.i_subtitle, i_word));
+            const auto it(std::lower_bound(std::cbegin(postings), std::cend(postings), at, [&](const WordIndex::Posting& posting, const auto& at){ return position(posting) < at; }));
+            return it != std::cend(postings) && position(*it) == at ? &*it : nullptr;
+        });
+
+        // Per completion, the last episode it was counted for, the postings being in episode order
+        std::unordered_map<unsigned, const Episode*> counted;
+        for (const WordIndex::Posting& posting : index.postings[ids[j_anchor]])
+        {
+            if (posting.i_word < j_anchor || posting.i_word - j_anchor + n_context >= posting.n_words)
+                continue;
+
+            // The word after the anchor is known from its posting, which rules most occurrences out without looking up the rest
+            if (j_anchor + 1 < n_context && posting.nextId != ids[j_anchor + 1])
+                continue;
+
+            // The last word's posting gives the completion
+            const unsigned i_first = posting.i_word - j_anchor;
+            const WordIndex::Posting* last(&posting);
+            bool matches(true);
+            for (unsigned j = 0; j < n_context && matches; ++j)
+                if (j != j_anchor)
+                {
+                    const WordIndex::Posting* found(find(j, posting, i_first + j));
+                    matches = found != nullptr;
+                    if (j + 1 == n_context)
+                        last = found;
+                }
+
+            if (!matches || last->nextId == WordIndex::noWord)
+                continue;
+
+            const std::string& completion(index.words[last->nextId]);
+            if (completion.compare(0, std::size(stem), stem) != 0)
+                continue;
+
+            if (const Episode*& lastEpisode = counted[last->nextId]; lastEpisode != posting.episode)
+            {
+                lastEpisode = posting.episode;
+                ++counts[completion];
+            }
+        }
+    }
+
+    std::string completedContext;
+    for (const std::string& word : context)
+        completedContext += word + ' ';
+
+    std::vector<std::pair<std::string, unsigned>> completions;
+    for (const auto& [word, n_episodes] : counts)
+        completions.emplace_back(completedContext + word, n_episodes);
+
+    std::stable_sort(std::begin(completions), std::end(completions), [](const auto& lhs, const auto& rhs){ return lhs.second > rhs.second; });
+    if (limit != 0 && std::size(completions) > limit)
+        completions.resize(limit);
+
+    return completions;
+}
+
+unsigned completionLimit(const Request& request)
+{
+    const auto it(request.options.find("limit"s));
+    try
+    {
+        return it != std::end(request.options) ? unsigned(parseNumber(it->second, maxLimitOption)) : 10;
+    }
+    catch (const std::logic_error&)
+    {
+        throw std::runtime_error("Invalid value '"s + it->second + "' for option 'limit'"s);
+    }
+}
+
+void handleCompletion(const Corpus& corpus, const Request& request)
+{
+    const std::vector<std::pair<std::string, unsigned>> completions(completePrefix(corpus, request.argument, completionLimit(request)));
+    std::cout << std::size(completions) << (!corpus.wordIndex ? " truncated"s : ""s) << (corpus.partial ? " partial"s : ""s) << '\n';
+    for (const auto& [completion, n_episodes] : completions)
+        std::cout << n_episodes << '\n' << completion << "\n\n"s;
+
+    std::cout << std::flush;
+}
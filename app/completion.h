@@ -0,0 +1,27 @@
+#pragma once
+#include "corpus.h"
+#include "request.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+    The completions of prefix, most frequent first, as the completed text and the number of episodes it's in.
+    Unless prefix ends between words, its last word is completed to the words starting with it that follow the words before it in some subtitle,
+    otherwise the word following them is added. Words are normalized as for searchWords, and a completion is of the normalized prefix.
+    Completions come from the word index alone, without reading the subtitles' text: the words starting with a prefix are a range of its sorted words,
+    and the words following others are found from the postings of the rarest of them, the others' postings being looked up by position,
+    and each posting giving the word after it.
+*/
+std::vector<std::pair<std::string, unsigned>> completePrefix(const Corpus& corpus, const std::string& prefix, unsigned limit);
+
+/*
+    Completions are requested with
+        :complete[\tlimit=<n>]\t<prefix>
+    with a limit of 0 for all of them. Output is the number of completions, followed by " truncated" if the word index was dropped and " partial" as for a search,
+    followed by, per completion, the number of episodes it's in, the completion and an empty line.
+*/
+unsigned completionLimit(const Request& request);
+
+void handleCompletion(const Corpus& corpus, const Request& request);
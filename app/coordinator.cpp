@@ -0,0 +1,492 @@
+#include "coordinator.h"
+#include "completion.h"
+#include "handlers.h"
+#include "liveFeed.h"
+#include "request.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace std::literals;
+
+#ifdef __linux__
+// An engine process for one shard of the corpus, started by the coordinator and talked to through pipes to its standard input and output
+class ShardProcess
+{
+    pid_t pid{-1};
+    int in{-1}, out{-1};
+    std::string buffer;
+
+public:
+    // args are the process's arguments (without the executable, which is this one)
+    ShardProcess(const std::vector<std::string>& args)
+    {
+        // Prepared before forking, as the child may only make async-signal-safe calls before exec
+        std::vector<char*> argv{const_cast<char*>("karen")};
+        for (const std::string& arg : args)
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        argv.push_back(nullptr);
+
+        int toShard[2], fromShard[2];
+        if (pipe2(toShard, O_CLOEXEC) != 0)
+            throw std::runtime_error("Could not create a pipe to a shard process"s);
+
+        if (pipe2(fromShard, O_CLOEXEC) != 0)
+        {
+            close(toShard[0]);
+            close(toShard[1]);
+            throw std::runtime_error("Could not create a pipe from a shard process"s);
+        }
+
+        pid = fork();
+        if (pid == 0)
+        {
+            dup2(toShard[0], STDIN_FILENO);
+            dup2(fromShard[1], STDOUT_FILENO);
+            execv("/proc/self/exe", argv.data());
+            _exit(EXIT_FAILURE);
+        }
+
+        close(toShard[0]);
+        close(fromShard[1]);
+        in = toShard[1];
+        out = fromShard[0];
+        if (pid == -1)
+        {
+            closeInput();
+            close(out);
+            throw std::runtime_error("Could not start a shard process"s);
+        }
+    }
+
+    ShardProcess(const ShardProcess&) = delete;
+    ShardProcess& operator=(const ShardProcess&) = delete;
+
+    ~ShardProcess()
+    {
+        closeInput();
+        close(out);
+        if (pid != -1)
+            waitpid(pid, nullptr, 0);
+    }
+
+    void writeLine(const std::string& line)
+    {
+        const std::string data(line + '\n');
+        for (std::size_t i = 0; i < std::size(data);)
+        {
+            const ssize_t n(write(in, data.data() + i, std::size(data) - i));
+            if (n <= 0)
+                throw std::runtime_error("Could not write to a shard process"s);
+
+            i += std::size_t(n);
+        }
+    }
+
+    // The shard process finishes the requests it has and exits once its input is closed
+    void closeInput()
+    {
+        if (in != -1)
+            close(in);
+
+        in = -1;
+    }
+
+    // Returns false once the shard process's output has ended
+    bool readLine(std::string& line)
+    {
+        for (std::size_t i_newline; (i_newline = buffer.find('\n')) == std::string::npos;)
+        {
+            char chunk[4096];
+            const ssize_t n(read(out, chunk, sizeof chunk));
+            if (n <= 0)
+                return false;
+
+            buffer.append(chunk, std::size_t(n));
+        }
+
+        const std::size_t i_newline(buffer.find('\n'));
+        line = buffer.substr(0, i_newline);
+        buffer.erase(0, i_newline + 1);
+        return true;
+    }
+};
+#endif
+
+// One result of a shard's response, as printed by printResults
+struct ShardResult
+{
+    double similarity; // Or the count, for completions and stats
+    std::string name;  // The episode name, or the completion or component
+    std::string text;
+};
+
+// A shard's response to a search, either a batch of streamed results or the final results
+struct ShardResponse
+{
+    bool final;
+    bool truncated, partial;
+    std::vector<ShardResult> results;
+    std::string error; // If the shard couldn't handle the request, see printError
+};
+
+/*
+    Coordinates engine processes for each of n shards of the corpus, so that together they answer queries as one engine would.
+    Each request is passed to all the shards. Streamed batches are passed on as they arrive,
+    and the shards' final results are merged into one list ordered as one engine would order them (see Merge), and then limited.
+    Cancellations are passed to all the shards as soon as they're read. If any shard answers with an error, so does the coordinator,
+    once all the shards have answered, so that as from one engine the error ends the response after whatever batches were passed on.
+*/
+class Coordinator
+{
+public:
+    // How the shards' final results are merged
+    enum class Merge
+    {
+        search,       // Sorted as sortResults sorts them
+        counted,      // Each a count and a name, the shards' counts of a name adding up, sorted by count
+        episodes,     // In the corpus's order of episodes, as :at lists them
+        concatenated, // In the shards' order, as only the first shard handles the live feed
+    };
+
+private:
+    // How a request is to be answered, see request
+    struct Answer
+    {
+        unsigned limit;
+        Merge merge;
+        std::string error; // If the request isn't valid, in which case it isn't passed to the shards
+    };
+
+#ifdef __linux__
+    std::vector<std::unique_ptr<ShardProcess>> shards;
+#endif
+    std::vector<std::thread> readers;
+    std::thread merger;
+
+    // Everything below is guarded by mutex
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<std::deque<ShardResponse>> responses; // Per shard, in order of request
+    std::vector<bool> ended;                          // Per shard, whether its output has ended
+    std::deque<Answer> answers;                       // Per request still to be answered, in order
+    bool closed{false};
+
+    void readResponses(unsigned i_shard)
+    {
+#ifdef __linux__
+        ShardProcess& shard(*shards[i_shard]);
+        for (std::string line; shard.readLine(line);)
+            try
+            {
+                std::istringstream header(line);
+                std::string count;
+                if (!(header >> count))
+                    throw std::runtime_error("Expected a count of results"s);
+
+                ShardResponse response{count[0] != '~', false, false, {}, ""s};
+                // An error has no results and ends the response, even after batches, see printError
+                if (count == "error"s)
+                    response.error = line.substr(std::size("error "s));
+                else
+                    for (std::string flag; header >> flag;)
+                    {
+                        response.truncated |= flag == "truncated"s;
+                        response.partial |= flag == "partial"s;
+                    }
+
+                // Each result is a number of lines ended by an empty line
+                for (unsigned n(!response.error.empty() ? 0 : std::stoul(response.final ? count : count.substr(1))); n != 0; --n)
+                {
+                    ShardResult result{0, ""s, ""s};
+                    for (std::string resultLine; shard.readLine(resultLine) && !resultLine.empty();)
+                        result.text += resultLine + '\n';
+
+                    result.text += '\n';
+                    result.similarity = std::stod(result.text);
+                    const std::size_t i_name(result.text.find('\n') + 1);
+                    result.name = result.text.substr(i_name, result.text.find('\n', i_name) - i_name);
+                    response.results.push_back(std::move(result));
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                responses[i_shard].push_back(std::move(response));
+                condition.notify_all();
+            }
+            catch (const std::exception& e)
+            {
+                std::clog
+                    << "Warning: error reading the response of shard "s << i_shard << " '"s << line << "':\n"s
+                    << e.what() << '\n';
+
+                // Where the shard's next response starts can't be told any more, so the request fails and the shard is no longer listened to
+                std::lock_guard<std::mutex> lock(mutex);
+                responses[i_shard].push_back(ShardResponse{true, false, false, {}, "Could not read the response of shard "s + std::to_string(i_shard)});
+                break;
+            }
+#endif
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ended[i_shard] = true;
+            condition.notify_all();
+        }
+
+#ifdef __linux__
+        // Read to the end, so that a shard that isn't listened to doesn't block writing
+        for (std::string line; shard.readLine(line);)
+            ;
+#endif
+    }
+
+    void printResponse(const std::string& header, const std::vector<ShardResult>& results)
+    {
+        std::cout << header << '\n';
+        for (const ShardResult& result : results)
+            std::cout << result.text;
+
+        std::cout << std::flush;
+    }
+
+    void mergeResponses()
+    {
+        const unsigned n_shards = unsigned(std::size(responses));
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            condition.wait(lock, [&]{ return closed || !answers.empty(); });
+            if (answers.empty())
+                return;
+
+            const Answer answer(std::move(answers.front()));
+            answers.pop_front();
+            if (!answer.error.empty())
+            {
+                printError(answer.error);
+                continue;
+            }
+
+            std::vector<bool> answered(n_shards);
+            ShardResponse merged{true, false, false, {}, ""s};
+            while (std::count(std::cbegin(answered), std::cend(answered), true) != n_shards)
+            {
+                condition.wait(lock, [&]
+                {
+                    for (unsigned i = 0; i < n_shards; ++i)
+                        if (!answered[i] && (!responses[i].empty() || ended[i]))
+                            return true;
+
+                    return false;
+                });
+
+                for (unsigned i = 0; i < n_shards; ++i)
+                {
+                    while (!answered[i] && !responses[i].empty())
+                    {
+                        ShardResponse response(std::move(responses[i].front()));
+                        responses[i].pop_front();
+                        if (!response.final)
+                        {
+                            printResponse('~' + std::to_string(std::size(response.results)), response.results);
+                            continue;
+                        }
+
+                        answered[i] = true;
+                        if (merged.error.empty())
+                            merged.error = response.error;
+
+                        merged.truncated |= response.truncated;
+                        merged.partial |= response.partial;
+                        merged.results.insert(std::end(merged.results), std::make_move_iterator(std::begin(response.results)), std::make_move_iterator(std::end(response.results)));
+                    }
+
+                    // A shard that has gone away can't answer, so the results are incomplete
+                    if (!answered[i] && responses[i].empty() && ended[i])
+                    {
+                        answered[i] = true;
+                        merged.truncated = true;
+                    }
+                }
+            }
+
+            // A request that any shard couldn't handle wasn't handled
+            if (!merged.error.empty())
+            {
+                printError(merged.error);
+                continue;
+            }
+
+            // The shards' counts of the same completion (or component) add up, those with the same count being in order
+            if (answer.merge == Merge::counted)
+            {
+                std::map<std::string, double> counts;
+                for (const ShardResult& result : merged.results)
+                    counts[result.name] += result.similarity;
+
+                merged.results.clear();
+                for (const auto& [name, count] : counts)
+                    merged.results.push_back({count, name, std::to_string(std::uint64_t(count)) + '\n' + name + "\n\n"s});
+            }
+
+            // Those that score the same are by name as sortResults orders them, and of the same name, in a shard's order, which is the order in the episode's text
+            if (answer.merge == Merge::search || answer.merge == Merge::counted)
+                std::stable_sort(std::begin(merged.results), std::end(merged.results), [](const ShardResult& lhs, const ShardResult& rhs){ return lhs.similarity > rhs.similarity || (lhs.similarity == rhs.similarity && lhs.name < rhs.name); });
+            // The corpus lists its episodes by name, the first number of each being a count of subtitles rather than a score
+            else if (answer.merge == Merge::episodes)
+                std::stable_sort(std::begin(merged.results), std::end(merged.results), [](const ShardResult& lhs, const ShardResult& rhs){ return lhs.name < rhs.name; });
+
+            if (answer.limit != 0 && std::size(merged.results) > answer.limit)
+                merged.results.resize(answer.limit);
+
+            printResponse(std::to_string(std::size(merged.results)) + (merged.truncated ? " truncated"s : ""s) + (merged.partial ? " partial"s : ""s), merged.results);
+        }
+    }
+
+public:
+    // shardArgs are the arguments for the shard processes, to which each shard's --shard option is added
+    Coordinator(const std::vector<std::string>& shardArgs, unsigned n_shards)
+        : responses(n_shards), ended(n_shards)
+    {
+#ifdef __linux__
+        // A shard process that has gone away shouldn't take the coordinator with it
+        std::signal(SIGPIPE, SIG_IGN);
+        for (unsigned i = 0; i < n_shards; ++i)
+        {
+            std::vector<std::string> args(shardArgs);
+            args.push_back("--shard="s + std::to_string(i) + '/' + std::to_string(n_shards));
+            shards.push_back(std::make_unique<ShardProcess>(args));
+        }
+#else
+        throw std::runtime_error("Coordinating shard processes isn't supported on this platform"s);
+#endif
+
+        for (unsigned i = 0; i < n_shards; ++i)
+            readers.emplace_back([this, i]{ readResponses(i); });
+
+        merger = std::thread([this]{ mergeResponses(); });
+    }
+
+    ~Coordinator()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            condition.notify_all();
+        }
+
+#ifdef __linux__
+        for (const std::unique_ptr<ShardProcess>& shard : shards)
+            shard->closeInput();
+#endif
+
+        merger.join();
+        for (std::thread& reader : readers)
+            reader.join();
+    }
+
+    // Passes on a request, of which all but cancellations are answered, the shards' results being merged as given
+    void request(const std::string& line, bool answered, unsigned limit, Merge merge = Merge::search)
+    {
+        if (answered)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            answers.push_back(Answer{limit, merge, ""s});
+            condition.notify_all();
+        }
+
+#ifdef __linux__
+        for (const std::unique_ptr<ShardProcess>& shard : shards)
+            try
+            {
+                shard->writeLine(line);
+            }
+            catch (const std::exception& e)
+            {
+                std::clog << "Warning: " << e.what() << '\n';
+            }
+#endif
+    }
+
+    // Answers a request that isn't valid with an error, in its turn, without passing it on
+    void reject(const std::string& error)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        answers.push_back(Answer{0, Merge::search, error});
+        condition.notify_all();
+    }
+};
+
+void coordinateQueries(const std::vector<std::string>& shardArgs, unsigned n_shards, const SearchOptions& options)
+{
+    Coordinator coordinator(shardArgs, n_shards);
+    for (std::string line; std::getline(std::cin, line);)
+        try
+        {
+            /*
+                Requests are checked here, as a request that one shard can't handle might be handled by another, whose answer would then be out of turn.
+                All but cancellations are answered.
+            */
+            const Request request(parseRequest(line));
+            if (request.command == "cancel"s)
+                coordinator.request(line, false, 0);
+            // The shards' counts have to be added up before the limit applies, so the shards give all their completions
+            else if (request.command == "complete"s)
+            {
+                std::string unlimited(":complete"s);
+                for (const auto& [name, value] : request.options)
+                    if (name != "limit"s)
+                        unlimited += '\t' + name + '=' + value;
+
+                coordinator.request(unlimited + "\tlimit=0\t"s + request.argument, true, completionLimit(request), Coordinator::Merge::counted);
+            }
+            else if (request.command == "stats"s)
+                coordinator.request(line, true, 0, Coordinator::Merge::counted);
+            else if (request.command == "at"s)
+            {
+                parseAtRequest(request);
+                coordinator.request(line, true, 0, Coordinator::Merge::episodes);
+            }
+            else if (request.command == "watch"s)
+            {
+                LiveFeed::watchOptions(request, options);
+                coordinator.request(line, true, 0, Coordinator::Merge::concatenated);
+            }
+            else if (request.command == "feed"s)
+            {
+                LiveFeed::feedSubtitle(request);
+                coordinator.request(line, true, 0, Coordinator::Merge::concatenated);
+            }
+            else if (request.command.empty() || request.command == "search"s)
+                coordinator.request(line, true, searchRequestOptions(request, options).limit);
+            else
+                throw std::runtime_error("Unknown command '"s + request.command + "'"s);
+        }
+        catch (const std::exception& e)
+        {
+            std::clog
+                << "Warning: error handling query '"s << line << "':\n"s
+                << e.what() << '\n';
+
+            // A cancellation is never answered
+            if (!isCancellation(line))
+                coordinator.reject(e.what());
+        }
+}
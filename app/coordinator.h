@@ -0,0 +1,8 @@
+#pragma once
+#include "search.h"
+
+#include <string>
+#include <vector>
+
+// Starts an engine process for each of n_shards shards of the corpus and answers the queries on standard input with them, as one engine would, see Coordinator
+void coordinateQueries(const std::vector<std::string>& shardArgs, unsigned n_shards, const SearchOptions& options);
@@ -0,0 +1,429 @@
+#include "corpus.h"
+#include "wordIndex.h"
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <stdexcept>
+#include <tuple>
+
+using namespace std::literals;
+
+std::vector<std::string> split(std::string text, std::string delimiter)
+{
+    std::vector<std::string> ret;
+    auto it_from(std::begin(text));
+    for (;;)
+    {
+        auto it_to(std::search(it_from, std::end(text), std::begin(delimiter), std::end(delimiter)));
+        ret.push_back(std::string(it_from, it_to));
+            
+        if (it_to == std::end(text))
+            break;
+
+        it_from = it_to + std::size(delimiter);
+    }
+
+    return ret;
+}
+
+offsets_t loadOffsets(const std::experimental::filesystem::path& filepath)
+{
+    offsets_t ret;
+    std::ifstream in(filepath);
+    for (auto [i_line, line](std::tuple<unsigned, std::string>{}); std::getline(in, line); ++i_line)
+    {
+        if (std::empty(line))
+            continue;
+
+        std::smatch match;
+        std::regex_match(line, match, std::regex(R"((.*): (-?\d+)\s*)"));
+        if (std::size(match) != 3)
+        {
+            std::clog
+                << "Warning: syntax error on line "s << i_line + 1 << " of map file "s << filepath << ":\n"s
+                << line << '\n';
+            
+            continue;
+        }
+
+        ret[match[1]] = std::stoll(match[2]) * 1ms;
+    }
+
+    return ret;
+}
+
+std::chrono::milliseconds loadTime(const std::string& in)
+{
+    std::smatch match;
+    std::regex_match(in, match, std::regex(R"((\d+):(\d+):(\d+)\.(\d+))"));
+    if (std::size(match) != 5)
+        throw std::runtime_error("Time '"s + in + "' does not match expected format"s);
+
+    return std::stoul(match[1]) * 1h + std::stoul(match[2]) * 1min + std::stoul(match[3]) * 1s + std::stoul(match[4]) * 1ms;
+}
+
+Subtitle loadSubtitle(const std::string& in)
+{
+    Subtitle subtitle;
+    std::smatch match;
+    std::regex_match(in, match, std::regex(R"((\d+:\d+:\d+\.\d+), (\d+:\d+:\d+\.\d+), *(.*))"));
+    if (std::size(match) != 4)
+        throw std::runtime_error("Subtitle '"s + in + "' does not match expected format"s);
+
+    try
+    {
+        subtitle.time_begin = loadTime(match[1]);
+        subtitle.time_end = loadTime(match[2]);
+        subtitle.text = match[3];
+    }
+    catch (const std::exception& e)
+    {
+        throw std::runtime_error("Error parsing subtitle '"s + in + "': "s + e.what());
+    }
+
+    return subtitle;
+}
+
+std::vector<Subtitle> loadSubtitles(const std::experimental::filesystem::path& filepath)
+{
+    std::vector<Subtitle> ret;
+    std::ifstream subtitleFile(filepath);
+    for (auto [i_line, line](std::tuple<unsigned, std::string>{}); std::getline(subtitleFile, line); ++i_line)
+        try
+        {
+            if (!line.empty())
+                ret.push_back(loadSubtitle(line));
+        }
+        catch (const std::exception& e)
+        {
+            std::clog
+                << "Warning: error on line "s << i_line + 1 << " of subtitle file "s << filepath << ":\n"s
+                << e.what() << '\n';
+
+            continue;
+        }
+
+    // Episodes are split, and searches scoped to a time window, by the subtitles being in order of time
+    std::stable_sort(std::begin(ret), std::end(ret), [](const Subtitle& lhs, const Subtitle& rhs){ return lhs.time_begin < rhs.time_begin; });
+    return ret;
+}
+
+std::vector<EpisodeNameAndOffset> pairEpisodeNameAndOffsets(std::vector<std::string> episodeNames, const offsets_t& offsets)
+{
+    std::vector<EpisodeNameAndOffset> ret;
+    for (const std::string& name : episodeNames)
+        try
+        {
+            ret.push_back(EpisodeNameAndOffset{name, offsets.at(name)});
+        }
+        catch (const std::exception& e)
+        {
+            std::clog
+                << "Warning: error getting offset for episode '"s << name << "'\n:"s
+                << e.what() << '\n';
+        }
+
+    return ret;
+}
+
+// Without histograms if they've been dropped, see fitMemoryBudget
+Episode buildEpisode(const episodeName_t& name, const std::deque<Subtitle>& subtitles, bool histograms)
+{
+    const auto buffers(std::make_shared<EpisodeBuffers>());
+    const auto histogramBuffer(histograms ? std::make_shared<std::vector<Histogram<std::uint8_t>>>() : nullptr);
+    buffers->subtitles.reserve(std::size(subtitles));
+    buffers->subtitleBegins.reserve(std::size(subtitles));
+    buffers->latestEnds.reserve(std::size(subtitles));
+    if (histogramBuffer)
+        histogramBuffer->reserve(std::size(subtitles));
+
+    for (const Subtitle& subtitle : subtitles)
+    {
+        if (!buffers->subtitleBegins.empty())
+            buffers->text += subtitleSeparator;
+
+        buffers->subtitles.push_back({subtitle.time_begin, subtitle.time_end});
+        buffers->subtitleBegins.push_back(unsigned(std::size(buffers->text)));
+        buffers->text += subtitle.text;
+        if (histogramBuffer)
+            histogramBuffer->emplace_back(subtitle.text);
+
+        buffers->latestEnds.push_back(std::max(subtitle.time_end, buffers->latestEnds.empty() ? subtitle.time_end : buffers->latestEnds.back()));
+    }
+
+    Episode episode;
+    episode.name = name;
+    episode.subtitles = buffers->subtitles;
+    episode.text = buffers->text;
+    episode.subtitleBegins = buffers->subtitleBegins;
+    episode.latestEnds = buffers->latestEnds;
+    episode.storage = buffers;
+    if (histogramBuffer)
+    {
+        episode.histograms = *histogramBuffer;
+        episode.histogramStorage = histogramBuffer;
+    }
+
+    return episode;
+}
+
+std::string_view episodeText(const Episode& episode)
+{
+    if (!episode.dictionary)
+        return episode.text;
+
+    thread_local std::string text;
+    text.clear();
+    for (unsigned i = 0; i < std::size(episode.subtitles); ++i)
+    {
+        if (i != 0)
+            text += subtitleSeparator;
+
+        episode.dictionary->decode(episode.compressedText.substr(episode.compressedBegins[i], episode.compressedBegins[i + 1] - episode.compressedBegins[i]), text);
+    }
+
+    return text;
+}
+
+std::string_view subtitleText(const Episode& episode, unsigned i)
+{
+    if (episode.dictionary)
+    {
+        thread_local std::string text;
+        text.clear();
+        episode.dictionary->decode(episode.compressedText.substr(episode.compressedBegins[i], episode.compressedBegins[i + 1] - episode.compressedBegins[i]), text);
+        return text;
+    }
+
+    const unsigned
+        i_begin = episode.subtitleBegins[i],
+        i_end = i + 1 < std::size(episode.subtitles) ? episode.subtitleBegins[i + 1] - unsigned(sizeof subtitleSeparator) : unsigned(std::size(episode.text));
+
+    return episode.text.substr(i_begin, i_end - i_begin);
+}
+
+// The episode with its text compressed by dictionary
+Episode compressEpisode(const Episode& episode, const std::shared_ptr<const TextDictionary>& dictionary)
+{
+    const auto buffers(std::make_shared<EpisodeBuffers>());
+    buffers->subtitles.assign(std::cbegin(episode.subtitles), std::cend(episode.subtitles));
+    buffers->subtitleBegins.assign(std::cbegin(episode.subtitleBegins), std::cend(episode.subtitleBegins));
+    buffers->latestEnds.assign(std::cbegin(episode.latestEnds), std::cend(episode.latestEnds));
+    buffers->compressedBegins.reserve(std::size(episode.subtitles) + 1);
+    for (unsigned i = 0; i < std::size(episode.subtitles); ++i)
+    {
+        buffers->compressedBegins.push_back(unsigned(std::size(buffers->compressedText)));
+        dictionary->encode(subtitleText(episode, i), buffers->compressedText);
+    }
+
+    buffers->compressedBegins.push_back(unsigned(std::size(buffers->compressedText)));
+    buffers->compressedText.shrink_to_fit();
+
+    Episode compressed;
+    compressed.name = episode.name;
+    compressed.subtitles = buffers->subtitles;
+    compressed.subtitleBegins = buffers->subtitleBegins;
+    compressed.histograms = episode.histograms;
+    compressed.histogramStorage = episode.histogramStorage;
+    compressed.latestEnds = buffers->latestEnds;
+    compressed.dictionary = dictionary;
+    compressed.compressedText = buffers->compressedText;
+    compressed.compressedBegins = buffers->compressedBegins;
+    compressed.storage = buffers;
+    return compressed;
+}
+
+std::vector<Subtitle> copySubtitles(const Episode& episode, unsigned i_first, unsigned i_last)
+{
+    std::vector<Subtitle> subtitles;
+    for (unsigned i = i_first; i <= i_last; ++i)
+        subtitles.push_back({episode.subtitles[i].time_begin, episode.subtitles[i].time_end, std::string(subtitleText(episode, i))});
+
+    return subtitles;
+}
+
+std::list<Episode> loadMultiEpisode(const std::experimental::filesystem::path& filepath, const offsets_t& offsets, bool histograms)
+{
+    std::clog << "Loading episodes: "s << filepath.stem().u8string() << '\n';
+    
+    std::vector<std::string> episodeNames(split(filepath.stem().u8string(), " - "s));
+    std::vector<EpisodeNameAndOffset> episodeNameAndOffsets(pairEpisodeNameAndOffsets(episodeNames, offsets));
+    std::sort(std::begin(episodeNameAndOffsets), std::end(episodeNameAndOffsets), [](const EpisodeNameAndOffset& lhs, const EpisodeNameAndOffset& rhs){ return lhs.offset < rhs.offset; });
+
+    std::vector<Subtitle> subtitles(loadSubtitles(filepath));
+    std::list<Episode> ret;
+    {
+        auto it_episodeAndOffset(std::rbegin(episodeNameAndOffsets)), it_end_episodeAndOffset(std::rend(episodeNameAndOffsets));
+        if (it_episodeAndOffset == it_end_episodeAndOffset)
+            return ret;
+
+        episodeName_t episodeName(it_episodeAndOffset->name);
+        std::deque<Subtitle> episodeSubtitles;
+        for (auto it(std::rbegin(subtitles)), it_end(std::rend(subtitles)); it != it_end; ++it)
+        {
+            if (it->time_begin < it_episodeAndOffset->offset)
+            {
+                ++it_episodeAndOffset;
+                if (it_episodeAndOffset == it_end_episodeAndOffset)
+                    break;
+
+                ret.push_front(buildEpisode(episodeName, episodeSubtitles, histograms));
+                episodeName = it_episodeAndOffset->name;
+                episodeSubtitles.clear();
+            }
+
+            episodeSubtitles.push_front(Subtitle{it->time_begin - it_episodeAndOffset->offset, it->time_end - it_episodeAndOffset->offset, it->text});
+        }
+
+        ret.push_front(buildEpisode(episodeName, episodeSubtitles, histograms));
+    }
+
+    return ret;
+}
+
+Alphabet extendAlphabet(const Alphabet& alphabet, const std::list<Episode>& episodes)
+{
+    std::array<bool, ALPHABET_SIZE> used{};
+    for (unsigned c = 0; c < ALPHABET_SIZE; ++c)
+        used[c] = alphabet.contains((unsigned char)c);
+
+    for (const Episode& episode : episodes)
+        for (unsigned char c : episode.text)
+            used[c] = true;
+
+    return Alphabet(used);
+}
+
+bool loadSubtitlesFile(Corpus& corpus, const std::experimental::filesystem::path& path)
+{
+    std::shared_ptr<const std::list<Episode>> episodes;
+    try
+    {
+        episodes = std::make_shared<const std::list<Episode>>(loadMultiEpisode(path, corpus.offsets, corpus.histograms));
+    }
+    catch (const std::exception& e)
+    {
+        std::clog
+            << "Warning: could not load episodes for subtitles file '"s << path << "'\n"s
+            << e.what() << '\n';
+
+        return false;
+    }
+
+    corpus.alphabet = extendAlphabet(corpus.alphabet, *episodes);
+    if (corpus.compressText)
+    {
+        // Loading progressively, the first file loaded has to stand for the corpus
+        if (!corpus.dictionary)
+        {
+            std::vector<std::string_view> texts;
+            for (const Episode& episode : *episodes)
+                texts.push_back(episode.text);
+
+            corpus.dictionary = std::make_shared<const TextDictionary>(texts);
+        }
+
+        auto compressed(std::make_shared<std::list<Episode>>());
+        for (const Episode& episode : *episodes)
+            compressed->push_back(compressEpisode(episode, corpus.dictionary));
+
+        episodes = std::move(compressed);
+    }
+
+    const auto it(std::find_if(std::begin(corpus.files), std::end(corpus.files), [&](const SubtitlesFile& file){ return file.path == path; }));
+    if (it != std::end(corpus.files))
+        *it = {path, std::move(episodes), nullptr};
+    else
+        corpus.files.push_back({path, std::move(episodes), nullptr});
+
+    return true;
+}
+
+void indexEpisodes(Corpus& corpus)
+{
+    corpus.episodes.clear();
+    corpus.episodesByName.clear();
+    for (SubtitlesFile& file : corpus.files)
+    {
+        for (const Episode& episode : *file.episodes)
+            corpus.episodes.push_back(&episode);
+
+        if (!file.words && corpus.wordIndex)
+            file.words = indexWords(*file.episodes);
+    }
+
+    std::stable_sort(std::begin(corpus.episodes), std::end(corpus.episodes), [](const Episode* lhs, const Episode* rhs){ return lhs->name < rhs->name; });
+    for (unsigned i = 0; i < std::size(corpus.episodes); ++i)
+        corpus.episodesByName.emplace(corpus.episodes[i]->name, i);
+}
+
+std::vector<std::experimental::filesystem::path> subtitlesFilepaths(const std::experimental::filesystem::path& subtitlesDirectory, const Shard& shard)
+{
+    std::vector<std::experimental::filesystem::path> paths;
+    for (std::experimental::filesystem::path path : std::experimental::filesystem::directory_iterator(subtitlesDirectory))
+        if (shard.contains(path))
+            paths.push_back(path);
+
+    std::sort(std::begin(paths), std::end(paths));
+    return paths;
+}
+
+// The files' episodes with their texts compressed by dictionary
+void compressFiles(std::vector<SubtitlesFile>& files, const std::shared_ptr<const TextDictionary>& dictionary)
+{
+    std::size_t textSize(0), compressedSize(0);
+    for (SubtitlesFile& file : files)
+    {
+        auto compressed(std::make_shared<std::list<Episode>>());
+        for (const Episode& episode : *file.episodes)
+        {
+            compressed->push_back(compressEpisode(episode, dictionary));
+            textSize += std::size(episode.text);
+            compressedSize += std::size(compressed->back().compressedText);
+        }
+
+        file.episodes = std::move(compressed);
+        file.words = nullptr;
+    }
+
+    std::clog << "Compressed the subtitles' text from "s << textSize << " to "s << compressedSize << " bytes\n"s;
+}
+
+Corpus loadCorpus(const std::experimental::filesystem::path& subtitlesDirectory, const std::experimental::filesystem::path& offsetsFilepath, const Shard& shard, bool progressive, bool compressText)
+{
+    Corpus corpus;
+    corpus.offsets = loadOffsets(offsetsFilepath);
+    corpus.partial = progressive;
+    corpus.compressText = compressText && progressive;
+    if (!progressive)
+        for (const std::experimental::filesystem::path& path : subtitlesFilepaths(subtitlesDirectory, shard))
+            loadSubtitlesFile(corpus, path);
+
+    // Loaded whole, the text is compressed once it's all loaded, so the dictionary is built from all of it
+    if (compressText && !progressive)
+    {
+        std::vector<std::string_view> texts;
+        for (const SubtitlesFile& file : corpus.files)
+            for (const Episode& episode : *file.episodes)
+                texts.push_back(episode.text);
+
+        corpus.dictionary = std::make_shared<const TextDictionary>(texts);
+        corpus.compressText = true;
+        compressFiles(corpus.files, corpus.dictionary);
+    }
+
+    indexEpisodes(corpus);
+    return corpus;
+}
+
+std::pair<unsigned, unsigned> subtitlesShowing(const Episode& episode, std::chrono::milliseconds time)
+{
+    const unsigned i_end = unsigned(std::upper_bound(std::cbegin(episode.subtitles), std::cend(episode.subtitles), time, [](std::chrono::milliseconds time, const SubtitleTimes& subtitle){ return time < subtitle.time_begin; }) - std::cbegin(episode.subtitles));
+    const unsigned i_first = unsigned(std::upper_bound(std::cbegin(episode.latestEnds), std::cbegin(episode.latestEnds) + i_end, time) - std::cbegin(episode.latestEnds));
+    return {i_first, i_end};
+}
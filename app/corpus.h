@@ -0,0 +1,219 @@
+#pragma once
+#include "k-mismatches/utility/alphabet.h"
+#include "k-mismatches/utility/dictionary.h"
+#include "k-mismatches/utility/histogram.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <experimental/filesystem>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+const static char subtitleSeparator = ' ';
+
+using episodeName_t = std::string;
+
+struct Subtitle
+{
+    std::chrono::milliseconds time_begin, time_end;
+    std::string text;
+};
+
+// A subtitle as kept in an episode, its text is found through the episode's subtitleBegins
+struct SubtitleTimes
+{
+    std::chrono::milliseconds time_begin, time_end;
+};
+
+// A read-only array in memory owned by something else
+template<typename T>
+class Span
+{
+    const T* elements{nullptr};
+    unsigned n{0};
+
+public:
+    Span() = default;
+
+    Span(const T* elements, unsigned n)
+        : elements(elements), n(n)
+    {}
+
+    Span(const std::vector<T>& vector)
+        : elements(vector.data()), n(unsigned(std::size(vector)))
+    {}
+
+    const T& operator[](unsigned i) const
+    {
+        return elements[i];
+    }
+
+    const T* begin() const
+    {
+        return elements;
+    }
+
+    const T* end() const
+    {
+        return elements + n;
+    }
+
+    unsigned size() const
+    {
+        return n;
+    }
+};
+
+/*
+    An episode views its data rather than owning it, so that the data can be either the episode's own buffers, if it was loaded,
+    or part of a corpus image mapped into memory and shared with other engine processes.
+*/
+struct Episode
+{
+    episodeName_t name;
+    Span<SubtitleTimes> subtitles;
+
+    // The subtitles' texts joined by subtitleSeparator, and the index into text where each subtitle begins
+    // Empty if the text is compressed, see episodeText
+    std::string_view text;
+    Span<unsigned> subtitleBegins;
+
+    // Per subtitle, for cheaply ruling subtitles out of a search, none if they've been dropped, see fitMemoryBudget
+    // If they were built, they're kept alive apart from the rest, so that dropping them frees them without copying the rest
+    Span<Histogram<std::uint8_t>> histograms;
+    std::shared_ptr<const std::vector<Histogram<std::uint8_t>>> histogramStorage;
+
+    // Per subtitle, the latest end of it and the subtitles before it, so that the subtitles showing at a time can be found by binary search, see subtitlesShowing
+    Span<std::chrono::milliseconds> latestEnds;
+
+    // If the text is compressed, each subtitle is compressed by dictionary on its own, without the separators,
+    // subtitle i being compressedText[compressedBegins[i], compressedBegins[i + 1])
+    std::shared_ptr<const TextDictionary> dictionary;
+    std::string_view compressedText;
+    Span<unsigned> compressedBegins;
+
+    // Keeps the memory viewed by the above alive
+    std::shared_ptr<const void> storage;
+};
+
+// The buffers of an episode that was loaded
+struct EpisodeBuffers
+{
+    std::vector<SubtitleTimes> subtitles;
+    std::string text;
+    std::vector<unsigned> subtitleBegins;
+    std::vector<std::chrono::milliseconds> latestEnds;
+    std::string compressedText;
+    std::vector<unsigned> compressedBegins;
+};
+
+struct EpisodeNameAndOffset
+{
+    std::string name;
+    std::chrono::milliseconds offset;
+};
+
+using offsets_t = std::unordered_map<episodeName_t, std::chrono::milliseconds>;
+
+struct WordIndex;
+
+// The episodes of one subtitles file, shared by the versions of the corpus until the file changes
+struct SubtitlesFile
+{
+    std::experimental::filesystem::path path;
+    std::shared_ptr<const std::list<Episode>> episodes;
+    std::shared_ptr<const WordIndex> words; // Built by indexEpisodes
+    bool mapped{false};                     // Whether the episodes view a corpus image
+};
+
+// Estimated bytes of memory in use by component, see corpusMemory
+using memoryUsage_t = std::map<std::string, std::size_t>;
+
+// A version of the corpus, never modified once published, the next version is a modified copy
+struct Corpus
+{
+    offsets_t offsets;
+    std::vector<SubtitlesFile> files; // In the order loaded
+
+    // All the files' episodes, in order by name (those of the same name in the order of their files), which doesn't depend on how the corpus is sharded,
+    // and the indices into episodes of the episodes by name
+    std::vector<const Episode*> episodes;
+    std::unordered_multimap<episodeName_t, unsigned> episodesByName;
+
+    // Dense codes for the bytes of the episodes' texts, so the engine's per-character tables are only as large as the corpus uses
+    Alphabet alphabet{std::array<bool, ALPHABET_SIZE>{}};
+
+    // Whether there are subtitles files still to be loaded
+    bool partial{false};
+
+    // Whether the episodes' texts are kept compressed by dictionary,
+    // which is built from the whole corpus, or from the first subtitles file if the corpus is loaded progressively
+    bool compressText{false};
+    std::shared_ptr<const TextDictionary> dictionary;
+
+    // Bytes that the engine should keep within (0 for no limit), for which the word index and the histograms may be dropped, see fitMemoryBudget
+    std::size_t memoryBudget{0};
+    bool wordIndex{true}, histograms{true};
+
+    // Tallied by fitMemoryBudget
+    memoryUsage_t memory;
+};
+
+// The part of the subtitles files that a process loads, each file belonging to one of n shards by the hash of its name
+struct Shard
+{
+    unsigned i{0}, n{1};
+
+    bool contains(const std::experimental::filesystem::path& filepath) const
+    {
+        // FNV-1a, so that all builds of the engine agree on the shards
+        std::uint32_t hash = 2166136261u;
+        for (unsigned char c : filepath.filename().u8string())
+            hash = (hash ^ c) * 16777619u;
+
+        return hash % n == i;
+    }
+};
+
+std::vector<std::string> split(std::string text, std::string delimiter);
+
+offsets_t loadOffsets(const std::experimental::filesystem::path& filepath);
+
+// The text of the episode, decompressed into a buffer of the thread's that the next call overwrites if it is compressed
+std::string_view episodeText(const Episode& episode);
+
+// Like episodeText, a compressed subtitle is decompressed into a buffer of the thread's (not the same as episodeText's)
+std::string_view subtitleText(const Episode& episode, unsigned i);
+
+// Copies of the subtitles i_first to i_last (inclusive) of episode
+std::vector<Subtitle> copySubtitles(const Episode& episode, unsigned i_first, unsigned i_last);
+
+// The alphabet of the episodes' texts together with that of alphabet
+Alphabet extendAlphabet(const Alphabet& alphabet, const std::list<Episode>& episodes);
+
+// Loads the subtitles file at path into corpus, replacing its previous version if it has one
+// Returns false (leaving corpus as it was) if the file couldn't be loaded
+bool loadSubtitlesFile(Corpus& corpus, const std::experimental::filesystem::path& path);
+
+// Lists the corpus's episodes, in order (see Corpus) and by name, and indexes the words of the files that haven't been
+void indexEpisodes(Corpus& corpus);
+
+// The subtitles files of the shard, in order by path
+std::vector<std::experimental::filesystem::path> subtitlesFilepaths(const std::experimental::filesystem::path& subtitlesDirectory, const Shard& shard);
+
+// If progressive, none of the subtitles files are loaded and the corpus is left partial, for CorpusWatcher to finish loading
+Corpus loadCorpus(const std::experimental::filesystem::path& subtitlesDirectory, const std::experimental::filesystem::path& offsetsFilepath, const Shard& shard, bool progressive, bool compressText);
+
+/*
+    The range [first, second) of the episode's subtitles from the first still showing at time to the last begun by it (some between may have ended),
+    empty if time falls between subtitles, in which case it's where the next subtitle is.
+    The subtitles are in order of their beginnings, and so are their latest ends, so both ends of the range are found by binary search.
+*/
+std::pair<unsigned, unsigned> subtitlesShowing(const Episode& episode, std::chrono::milliseconds time);
@@ -0,0 +1,276 @@
+#include "corpusImage.h"
+
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std::literals;
+
+/*
+    A corpus image is the loaded corpus written to a file, for other engine processes to map into memory instead of loading their own copy.
+    The episodes of a process that maps an image view it directly, so all the processes share the one copy.
+    The layout, in native byte order with every item padded to a multiple of 8 bytes, is
+        magic, version, number of files
+        per file: file name, number of episodes
+        per episode: name, number of subtitles, whether it has histograms, subtitles, subtitleBegins, histograms (if it has them), latestEnds, text
+    where counts and flags are 32-bit and strings are a 32-bit length followed by the characters.
+    An image is only trusted as far as the mapping goes: what it says is checked against it (see Reader) and against the text before the episodes view it.
+*/
+const std::string corpusImageMagic = "karencorpus"s;
+const std::uint32_t corpusImageVersion = 3;
+
+void writeCorpusImage(const Corpus& corpus, const std::experimental::filesystem::path& imageFilepath)
+{
+    // Written to a temporary file and renamed, so that a process never maps a partly written image
+    const std::experimental::filesystem::path temporaryFilepath(imageFilepath.string() + ".tmp"s + std::to_string(std::random_device()()));
+    {
+        std::ofstream image(temporaryFilepath, std::ios::binary);
+        const auto write([&](const void* data, std::size_t size)
+        {
+            static const char padding[8]{};
+            image.write(static_cast<const char*>(data), size);
+            image.write(padding, -size % 8);
+        });
+        const auto writeCount([&](std::size_t n){ const std::uint32_t count = std::uint32_t(n); write(&count, sizeof count); });
+        const auto writeString([&](std::string_view string){ writeCount(std::size(string)); write(string.data(), std::size(string)); });
+
+        writeString(corpusImageMagic);
+        writeCount(corpusImageVersion);
+        writeCount(std::size(corpus.files));
+        for (const SubtitlesFile& file : corpus.files)
+        {
+            writeString(file.path.filename().u8string());
+            writeCount(std::size(*file.episodes));
+            for (const Episode& episode : *file.episodes)
+            {
+                // The histograms may have been dropped, see fitMemoryBudget
+                const bool histograms(std::size(episode.histograms) != 0);
+                writeString(episode.name);
+                writeCount(std::size(episode.subtitles));
+                writeCount(histograms);
+                write(episode.subtitles.begin(), std::size(episode.subtitles) * sizeof(SubtitleTimes));
+                write(episode.subtitleBegins.begin(), std::size(episode.subtitles) * sizeof(unsigned));
+                if (histograms)
+                    write(episode.histograms.begin(), std::size(episode.subtitles) * sizeof(Histogram<std::uint8_t>));
+
+                write(episode.latestEnds.begin(), std::size(episode.subtitles) * sizeof(std::chrono::milliseconds));
+                writeString(episode.text);
+            }
+        }
+
+        if (!image)
+            throw std::runtime_error("Error writing corpus image "s + temporaryFilepath.string());
+    }
+
+    std::experimental::filesystem::rename(temporaryFilepath, imageFilepath);
+}
+
+// The contents of a corpus image file, mapped read-only where possible, otherwise read into memory
+class CorpusImage
+{
+    const char* data{nullptr};
+    std::size_t size{0};
+    std::string buffer;
+
+public:
+    CorpusImage(const std::experimental::filesystem::path& imageFilepath)
+    {
+#ifdef __linux__
+        const int fd(open(imageFilepath.c_str(), O_RDONLY | O_CLOEXEC));
+        if (fd == -1)
+            throw std::runtime_error("Could not open corpus image "s + imageFilepath.string());
+
+        struct stat status;
+        void* mapping(MAP_FAILED);
+        if (fstat(fd, &status) == 0 && status.st_size != 0)
+            mapping = mmap(nullptr, std::size_t(status.st_size), PROT_READ, MAP_SHARED, fd, 0);
+
+        close(fd);
+        if (mapping == MAP_FAILED)
+            throw std::runtime_error("Could not map corpus image "s + imageFilepath.string());
+
+        data = static_cast<const char*>(mapping);
+        size = std::size_t(status.st_size);
+#else
+        std::ifstream file(imageFilepath, std::ios::binary);
+        buffer.assign(std::istreambuf_iterator<char>(file), {});
+        if (!file)
+            throw std::runtime_error("Could not read corpus image "s + imageFilepath.string());
+
+        data = buffer.data();
+        size = std::size(buffer);
+#endif
+    }
+
+    CorpusImage(const CorpusImage&) = delete;
+    CorpusImage& operator=(const CorpusImage&) = delete;
+
+    ~CorpusImage()
+    {
+#ifdef __linux__
+        munmap(const_cast<char*>(data), size);
+#endif
+    }
+
+    // Reads the items of the image in order, checking that they're within it
+    class Reader
+    {
+        const CorpusImage& image;
+        std::size_t i{0};
+
+    public:
+        Reader(const CorpusImage& image)
+            : image(image)
+        {}
+
+        const char* read(std::size_t size)
+        {
+            const std::size_t paddedSize(size + -size % 8);
+            if (paddedSize > image.size - i)
+                throw std::runtime_error("Corpus image is truncated"s);
+
+            const char* item(image.data + i);
+            i += paddedSize;
+            return item;
+        }
+
+        template<typename T>
+        Span<T> readSpan(unsigned n)
+        {
+            return Span<T>(reinterpret_cast<const T*>(read(n * sizeof(T))), n);
+        }
+
+        std::uint32_t readCount()
+        {
+            return *reinterpret_cast<const std::uint32_t*>(read(sizeof(std::uint32_t)));
+        }
+
+        std::string_view readString()
+        {
+            const std::uint32_t n(readCount());
+            return std::string_view(read(n), n);
+        }
+
+        bool atEnd() const
+        {
+            return i == image.size;
+        }
+    };
+};
+
+// A corpus whose episodes view the image, which stays mapped for as long as any of them is in use
+Corpus attachCorpusImage(const std::experimental::filesystem::path& imageFilepath, const std::experimental::filesystem::path& subtitlesDirectory, const std::experimental::filesystem::path& offsetsFilepath)
+{
+    const auto image(std::make_shared<const CorpusImage>(imageFilepath));
+    CorpusImage::Reader reader(*image);
+    if (reader.readString() != corpusImageMagic || reader.readCount() != corpusImageVersion)
+        throw std::runtime_error("Not a corpus image, or one of a different version: "s + imageFilepath.string());
+
+    Corpus corpus;
+    corpus.offsets = loadOffsets(offsetsFilepath);
+    for (std::uint32_t n_files(reader.readCount()); n_files != 0; --n_files)
+    {
+        const std::experimental::filesystem::path path(subtitlesDirectory / std::string(reader.readString()));
+        std::list<Episode> episodes;
+        for (std::uint32_t n_episodes(reader.readCount()); n_episodes != 0; --n_episodes)
+        {
+            Episode episode;
+            episode.name = reader.readString();
+            const std::uint32_t n_subtitles(reader.readCount());
+            const std::uint32_t histograms(reader.readCount());
+            if (histograms > 1)
+                throw std::runtime_error("Corpus image is corrupt: episode '"s + episode.name + "' has a histograms flag of "s + std::to_string(histograms));
+
+            episode.subtitles = reader.readSpan<SubtitleTimes>(n_subtitles);
+            episode.subtitleBegins = reader.readSpan<unsigned>(n_subtitles);
+            if (histograms)
+                episode.histograms = reader.readSpan<Histogram<std::uint8_t>>(n_subtitles);
+
+            episode.latestEnds = reader.readSpan<std::chrono::milliseconds>(n_subtitles);
+            episode.text = reader.readString();
+
+            // Each subtitle's text is text[subtitleBegins[i], subtitleBegins[i + 1] - separator), so the begins must go up by at least a separator, and stay within the text
+            for (std::uint32_t i = 0; i < n_subtitles; ++i)
+            {
+                const unsigned begin(episode.subtitleBegins[i]);
+                if ((i == 0 ? begin != 0 : begin < episode.subtitleBegins[i - 1] + sizeof subtitleSeparator) || begin > std::size(episode.text))
+                    throw std::runtime_error("Corpus image is corrupt: subtitle "s + std::to_string(i) + " of episode '"s + episode.name + "' begins outside its text"s);
+            }
+
+            episode.storage = image;
+            episodes.push_back(std::move(episode));
+        }
+
+        corpus.alphabet = extendAlphabet(corpus.alphabet, episodes);
+        corpus.files.push_back({path, std::make_shared<const std::list<Episode>>(std::move(episodes)), nullptr, true});
+    }
+
+    if (!reader.atEnd())
+        throw std::runtime_error("Corpus image is corrupt: there's more to it than it says"s);
+
+    indexEpisodes(corpus);
+    return corpus;
+}
+
+// Whether the image file exists and was written after the last change to the subtitles directory and the offsets file
+bool isCorpusImageCurrent(const std::experimental::filesystem::path& imageFilepath, const std::experimental::filesystem::path& subtitlesDirectory, const std::experimental::filesystem::path& offsetsFilepath)
+{
+    namespace fs = std::experimental::filesystem;
+    if (!fs::exists(imageFilepath))
+        return false;
+
+    const fs::file_time_type imageTime(fs::last_write_time(imageFilepath));
+    if (fs::last_write_time(offsetsFilepath) > imageTime || fs::last_write_time(subtitlesDirectory) > imageTime)
+        return false;
+
+    for (const fs::directory_entry& entry : fs::directory_iterator(subtitlesDirectory))
+        if (fs::last_write_time(entry.path()) > imageTime)
+            return false;
+
+    return true;
+}
+
+Corpus loadSharedCorpus(const std::experimental::filesystem::path& imageFilepath, const std::experimental::filesystem::path& subtitlesDirectory, const std::experimental::filesystem::path& offsetsFilepath, const Shard& shard)
+{
+    try
+    {
+        if (isCorpusImageCurrent(imageFilepath, subtitlesDirectory, offsetsFilepath))
+            return attachCorpusImage(imageFilepath, subtitlesDirectory, offsetsFilepath);
+    }
+    catch (const std::exception& e)
+    {
+        std::clog
+            << "Warning: could not attach to corpus image "s << imageFilepath << ", loading the corpus instead\n"s
+            << e.what() << '\n';
+    }
+
+    Corpus corpus(loadCorpus(subtitlesDirectory, offsetsFilepath, shard, false, false));
+    try
+    {
+        writeCorpusImage(corpus, imageFilepath);
+        return attachCorpusImage(imageFilepath, subtitlesDirectory, offsetsFilepath);
+    }
+    catch (const std::exception& e)
+    {
+        std::clog
+            << "Warning: could not write corpus image "s << imageFilepath << ", the corpus won't be shared\n"s
+            << e.what() << '\n';
+    }
+
+    return corpus;
+}
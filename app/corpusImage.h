@@ -0,0 +1,10 @@
+#pragma once
+#include "corpus.h"
+
+#include <experimental/filesystem>
+
+/*
+    Attaches to the corpus image if it's current, otherwise loads the corpus and (re)writes the image before attaching to it.
+    So the first of several engine processes started on the same image loads the corpus, and the rest share it.
+*/
+Corpus loadSharedCorpus(const std::experimental::filesystem::path& imageFilepath, const std::experimental::filesystem::path& subtitlesDirectory, const std::experimental::filesystem::path& offsetsFilepath, const Shard& shard);
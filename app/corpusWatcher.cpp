@@ -0,0 +1,171 @@
+#include "corpusWatcher.h"
+#include "memoryUsage.h"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace std::literals;
+
+void CorpusWatcher::update(std::set<std::experimental::filesystem::path> changedPaths, bool offsetsChanged)
+{
+    Corpus next(*std::atomic_load(&corpus));
+    if (offsetsChanged)
+    {
+        offsets_t offsets(loadOffsets(offsetsFilepath));
+        const auto offsetOf([](const offsets_t& offsets, const std::string& name){ const auto it(offsets.find(name)); return it != std::end(offsets) ? std::optional(it->second) : std::nullopt; });
+        for (const SubtitlesFile& file : next.files)
+            for (const std::string& name : split(file.path.stem().u8string(), " - "s))
+                if (offsetOf(offsets, name) != offsetOf(next.offsets, name))
+                    changedPaths.insert(file.path);
+
+        next.offsets = std::move(offsets);
+    }
+
+    for (const std::experimental::filesystem::path& path : changedPaths)
+        if (std::experimental::filesystem::is_regular_file(path))
+            loadSubtitlesFile(next, path);
+        else
+        {
+            std::clog << "Unloading episodes: "s << path.stem().u8string() << '\n';
+            next.files.erase(std::remove_if(std::begin(next.files), std::end(next.files), [&](const SubtitlesFile& file){ return file.path == path; }), std::end(next.files));
+        }
+
+    indexEpisodes(next);
+    fitMemoryBudget(next);
+    std::atomic_store(&corpus, std::shared_ptr<const Corpus>(std::make_shared<Corpus>(std::move(next))));
+}
+
+void CorpusWatcher::loadProgressively()
+{
+    const std::vector<std::experimental::filesystem::path> paths(subtitlesFilepaths(subtitlesDirectory, shard));
+    for (unsigned i = 0; i < std::size(paths) && !stopped; ++i)
+    {
+        Corpus next(*std::atomic_load(&corpus));
+        loadSubtitlesFile(next, paths[i]);
+        indexEpisodes(next);
+        fitMemoryBudget(next);
+        next.partial = i + 1 < std::size(paths);
+        std::atomic_store(&corpus, std::shared_ptr<const Corpus>(std::make_shared<Corpus>(std::move(next))));
+    }
+
+    if (paths.empty())
+    {
+        Corpus next(*std::atomic_load(&corpus));
+        next.partial = false;
+        std::atomic_store(&corpus, std::shared_ptr<const Corpus>(std::make_shared<Corpus>(std::move(next))));
+    }
+}
+
+bool CorpusWatcher::startWatching()
+{
+#ifdef __linux__
+    fd = inotify_init1(IN_CLOEXEC);
+    const std::experimental::filesystem::path offsetsDirectory(offsetsFilepath.has_parent_path() ? offsetsFilepath.parent_path() : std::experimental::filesystem::path("."s));
+
+    // The offsets file's directory is watched rather than the file, so that it's seen when the file is replaced
+    const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE;
+    subtitlesWatch = inotify_add_watch(fd, subtitlesDirectory.c_str(), mask);
+    offsetsWatch = inotify_add_watch(fd, offsetsDirectory.c_str(), mask);
+    if (fd != -1 && subtitlesWatch != -1 && offsetsWatch != -1)
+        return true;
+
+    std::clog << "Warning: could not watch the subtitles directory and offsets file for changes, the corpus won't be reloaded\n"s;
+#else
+    std::clog << "Warning: watching the corpus for changes isn't supported on this platform, the corpus won't be reloaded\n"s;
+#endif
+    return false;
+}
+
+void CorpusWatcher::watch()
+{
+#ifdef __linux__
+    std::set<std::experimental::filesystem::path> changedPaths;
+    bool offsetsChanged(false);
+    while (!stopped)
+    {
+        // Wake up now and then to see if stopped
+        pollfd pollFd{fd, POLLIN, 0};
+        const bool pending = !changedPaths.empty() || offsetsChanged;
+        if (poll(&pollFd, 1, pending ? int(settleTime.count()) : 250) <= 0)
+        {
+            if (pending)
+                try
+                {
+                    update(std::move(changedPaths), offsetsChanged);
+                }
+                catch (const std::exception& e)
+                {
+                    std::clog
+                        << "Warning: error reloading the corpus:\n"s
+                        << e.what() << '\n';
+                }
+
+            changedPaths.clear();
+            offsetsChanged = false;
+            continue;
+        }
+
+        alignas(inotify_event) char buffer[4096];
+        const ssize_t n(read(fd, buffer, sizeof buffer));
+        for (const char* p(buffer); p < buffer + std::max(n, ssize_t(0));)
+        {
+            const inotify_event& event(*reinterpret_cast<const inotify_event*>(p));
+            p += sizeof(inotify_event) + event.len;
+
+            // Events were lost, so reload everything
+            if (event.mask & IN_Q_OVERFLOW)
+            {
+                offsetsChanged = true;
+                for (const SubtitlesFile& file : std::atomic_load(&corpus)->files)
+                    changedPaths.insert(file.path);
+                for (const std::experimental::filesystem::path& path : subtitlesFilepaths(subtitlesDirectory, shard))
+                    changedPaths.insert(path);
+
+                continue;
+            }
+
+            if (event.len == 0)
+                continue;
+
+            if (event.wd == offsetsWatch && event.name == offsetsFilepath.filename().u8string())
+                offsetsChanged = true;
+            else if (event.wd == subtitlesWatch && shard.contains(event.name))
+                changedPaths.insert(subtitlesDirectory / event.name);
+        }
+    }
+#endif
+}
+
+CorpusWatcher::CorpusWatcher(std::shared_ptr<const Corpus>& corpus, const std::experimental::filesystem::path& subtitlesDirectory, const std::experimental::filesystem::path& offsetsFilepath, const Shard& shard)
+    : corpus(corpus), subtitlesDirectory(subtitlesDirectory), offsetsFilepath(offsetsFilepath), shard(shard)
+{
+    thread = std::thread([this]
+    {
+        const bool watching(startWatching());
+        if (std::atomic_load(&this->corpus)->partial)
+            loadProgressively();
+
+        if (watching)
+            watch();
+    });
+}
+
+CorpusWatcher::~CorpusWatcher()
+{
+    stopped = true;
+    thread.join();
+#ifdef __linux__
+    if (fd != -1)
+        close(fd);
+#endif
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "corpus.h"
+
+#include <atomic>
+#include <chrono>
+#include <experimental/filesystem>
+#include <memory>
+#include <set>
+#include <thread>
+
+/*
+    Keeps the corpus up to date with the subtitles directory and the offsets file, which are watched with inotify.
+    It also finishes loading a corpus started partial, file by file, so that queries can be answered from what's loaded so far.
+    Only the subtitles files that changed, or whose episodes' offsets changed, are reloaded.
+    Each update is published as a new version of the corpus (by atomically swapping the pointer),
+    so a query uses the version that was current when it started and is never blocked by an update.
+*/
+class CorpusWatcher
+{
+    std::shared_ptr<const Corpus>& corpus;
+    const std::experimental::filesystem::path subtitlesDirectory, offsetsFilepath;
+    const Shard shard;
+    std::atomic<bool> stopped{false};
+#ifdef __linux__
+    int fd{-1}, subtitlesWatch{-1}, offsetsWatch{-1};
+#endif
+    std::thread thread;
+
+    // Changes arriving within this long of each other are applied as one update
+    static constexpr std::chrono::milliseconds settleTime{100};
+
+    void update(std::set<std::experimental::filesystem::path> changedPaths, bool offsetsChanged);
+
+    // Loads the subtitles files one at a time, publishing a version of the corpus after each
+    void loadProgressively();
+
+    // The watches are set up before any loading is done, so that no change is missed
+    bool startWatching();
+
+    void watch();
+
+public:
+    // If the corpus is partial, its subtitles files are loaded (in the background) before watching for changes
+    CorpusWatcher(std::shared_ptr<const Corpus>& corpus, const std::experimental::filesystem::path& subtitlesDirectory, const std::experimental::filesystem::path& offsetsFilepath, const Shard& shard);
+
+    ~CorpusWatcher();
+};
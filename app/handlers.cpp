@@ -0,0 +1,243 @@
+#include "handlers.h"
+#include "completion.h"
+#include "memoryUsage.h"
+#include "session.h"
+#include "wordIndex.h"
+#include "k-mismatches/kangaroo.h"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std::literals;
+
+/*
+    Output is the number of results, followed by " truncated" if the search was cancelled or ran out of time (or searched by word without the word index),
+    and " partial" if the corpus hasn't finished loading, followed by the results, best first.
+    If streaming, this is preceded by zero or more batches of results of the form "~<number of results>" followed by the results,
+    each batch being the results of one episode as soon as it has been searched.
+    The options are checked before anything is streamed, but if the search fails after streaming, as when memory runs out,
+    the error (see printError) takes the place of the count, ending the response. Either line ends one, and the batches before an error are void.
+*/
+// The session, if given, is used unless searching by word or the episodes' text as a whole, in which case the search isn't streamed
+void handleQuery(const Corpus& corpus, const std::string& query, const SearchOptions& options, const Deadline& deadline, Session* session = nullptr)
+{
+    // Searching by word, similarity is by the number of words
+    const unsigned m = options.words ? unsigned(std::size(findWords(query))) : unsigned(std::size(query));
+    const KangarooQuery preparedQuery(query, corpus.alphabet);
+    const std::function<void(std::vector<QueryResult>&)> streamResults([&](std::vector<QueryResult>& results)
+    {
+        sortResults(results);
+        std::cout << '~' << std::size(results) << '\n';
+        printResults(results, m, options);
+        std::cout << std::flush;
+    });
+
+    // Scoped by episode, only the episodes in scope are searched, which are looked up by name
+    std::vector<const Episode*> scoped;
+    if (isScoped(options) && !options.words)
+        scoped = scopedEpisodes(corpus, options);
+
+    const std::vector<const Episode*>& episodes(isScoped(options) ? scoped : corpus.episodes);
+    std::vector<QueryResult> results;
+    if (options.words)
+        results = searchWords(corpus, query, options, deadline);
+    else if (session && !options.episodeText)
+        results = session->search(episodes, preparedQuery, options, deadline);
+    else if (options.limit != 0 && m != 0)
+        results = searchExact(episodes, query, options, options.limit, deadline);
+
+    if (!options.words && !(session && !options.episodeText) && (std::size(results) < options.limit || options.limit == 0))
+        results = searchEpisodes(episodes, preparedQuery, options, deadline, options.stream ? streamResults : nullptr);
+
+    // Without the word index, searching by word finds nothing, which isn't all there is
+    // A search that finished just before the deadline expired is complete
+    const bool truncated(deadline.stopped() || (options.words && !corpus.wordIndex));
+    sortResults(results);
+    if (options.limit != 0 && std::size(results) > options.limit)
+        results.resize(options.limit);
+
+    // Searching by word doesn't match characters, so there's nothing to check it against
+    if (options.verify && !options.words && !truncated)
+        verifyResults(episodes, query, options, results);
+
+    std::cout << std::size(results) << (truncated ? " truncated"s : ""s) << (corpus.partial ? " partial"s : ""s) << '\n';
+    printResults(results, m, options);
+    std::cout << std::flush;
+}
+
+SearchOptions searchRequestOptions(const Request& request, SearchOptions options)
+{
+    for (const auto& [name, value] : request.options)
+        if (name != "id"s)
+            setSearchOption(options, name, value);
+
+    return options;
+}
+
+AtRequest parseAtRequest(const Request& request)
+{
+    AtRequest at{""s, 0ms, 2};
+    try
+    {
+        at.time = std::chrono::milliseconds(std::stoll(request.argument));
+        for (const auto& [name, value] : request.options)
+            if (name == "episode"s)
+                at.episode = value;
+            else if (name == "context"s)
+                at.context = unsigned(parseNumber(value, maxLimitOption));
+            else if (name != "id"s)
+                throw std::runtime_error("Unknown option '"s + name + "'"s);
+    }
+    // The numbers' conversions throw these, with no more than the conversion's name to say
+    catch (const std::logic_error&)
+    {
+        throw std::runtime_error("Expected a time and a context option that are numbers"s);
+    }
+
+    if (at.episode.empty())
+        throw std::runtime_error("Expected an episode option"s);
+
+    return at;
+}
+
+void handleAt(const Corpus& corpus, const Request& request)
+{
+    const AtRequest at(parseAtRequest(request));
+    std::vector<unsigned> indices;
+    const auto [it_begin, it_end] = corpus.episodesByName.equal_range(at.episode);
+    for (auto it(it_begin); it != it_end; ++it)
+        indices.push_back(it->second);
+
+    std::sort(std::begin(indices), std::end(indices));
+    std::cout << std::size(indices) << (corpus.partial ? " partial"s : ""s) << '\n';
+    for (unsigned i : indices)
+    {
+        const Episode& episode(*corpus.episodes[i]);
+        const auto [i_first, i_end] = subtitlesShowing(episode, at.time);
+        const unsigned
+            i_from = i_first - std::min(i_first, at.context),
+            i_to = std::min(i_end + at.context, std::size(episode.subtitles));
+
+        std::cout << i_end - i_first << '\n' << episode.name << '\n' << i_first - i_from << '\n';
+        for (unsigned i_subtitle = i_from; i_subtitle < i_to; ++i_subtitle)
+            std::cout << episode.subtitles[i_subtitle].time_begin.count() << ", " << episode.subtitles[i_subtitle].time_end.count() << ", " << subtitleText(episode, i_subtitle) << '\n';
+
+        std::cout << '\n';
+    }
+
+    std::cout << std::flush;
+}
+
+/*
+    The memory in use is requested with
+        :stats
+    Output is the number of components, followed by " partial" as for a search, followed by, per component, its estimated bytes, its name and an empty line,
+    largest first. The components are the corpus's (see corpusMemory), the sessions, the live feed, the most that matching against one text has taken,
+    and the total of them all.
+*/
+void handleStats(const Corpus& corpus, const LiveFeed* live, const Sessions& sessions)
+{
+    memoryUsage_t usage(corpus.memory);
+    usage["sessions"s] = sessions.memory();
+    usage["live feed"s] = live ? live->memory() : 0;
+    usage["matching"s] = peakMatchingMemory();
+    usage["total"s] = totalMemory(usage);
+
+    std::vector<std::pair<std::string, std::size_t>> components(std::cbegin(usage), std::cend(usage));
+    std::stable_sort(std::begin(components), std::end(components), [](const auto& lhs, const auto& rhs){ return lhs.second > rhs.second; });
+    std::cout << std::size(components) << (corpus.partial ? " partial"s : ""s) << '\n';
+    for (const auto& [name, bytes] : components)
+        std::cout << bytes << '\n' << name << "\n\n"s;
+
+    std::cout << std::flush;
+}
+
+// The live feed is only handled if live is given, otherwise its commands are ignored, giving no results
+// Throws if the request can't be handled
+void handleRequest(const std::shared_ptr<const Corpus>& p_corpus, const QueuedRequest& queuedRequest, const SearchOptions& defaultOptions, LiveFeed* live, Sessions& sessions)
+{
+    const Corpus& corpus(*p_corpus);
+    const Request& request(queuedRequest.request);
+    if (request.command == "watch"s)
+    {
+        if (live)
+            live->watch(request, defaultOptions);
+
+        std::cout << "0\n"s << std::flush;
+        return;
+    }
+
+    if (request.command == "complete"s)
+        return handleCompletion(corpus, request);
+
+    if (request.command == "stats"s)
+        return handleStats(corpus, live, sessions);
+
+    if (request.command == "at"s)
+        return handleAt(corpus, request);
+
+    if (request.command == "feed"s)
+    {
+        if (live)
+            live->feed(request);
+        else
+            std::cout << "0\n"s << std::flush;
+
+        return;
+    }
+
+    if (!request.command.empty() && request.command != "search"s)
+        throw std::runtime_error("Unknown command '"s + request.command + "'"s);
+
+    const SearchOptions options(searchRequestOptions(request, defaultOptions));
+
+    const auto time(options.budget != 0ms ? std::chrono::steady_clock::now() + options.budget : std::chrono::steady_clock::time_point::max());
+    handleQuery(corpus, request.argument, options, Deadline(time, queuedRequest.cancelled.get()), options.session.empty() ? nullptr : &sessions.get(options.session, p_corpus));
+}
+
+void handleQueries(const std::shared_ptr<const Corpus>& corpus, const SearchOptions& options, LiveFeed* live)
+{
+    // Output is flushed explicitly, input is read by another thread
+    std::cin.tie(nullptr);
+
+    RequestQueue requests;
+    Sessions sessions;
+    std::thread reader([&]{ requests.read(std::cin); });
+    while (std::optional<QueuedRequest> request = requests.pop())
+    {
+        const std::shared_ptr<const Corpus> current(std::atomic_load(&corpus));
+        try
+        {
+            if (!request->error.empty())
+                throw std::runtime_error(request->error);
+
+            handleRequest(current, *request, options, live, sessions);
+        }
+        catch (const std::exception& e)
+        {
+            std::clog
+                << "Warning: error handling query '"s << request->line << "':\n"s
+                << e.what() << '\n';
+            printError(e.what());
+        }
+
+        // The sessions have what the rest leaves of the memory budget (see fitMemoryBudget), up to their own limit
+        std::size_t sessionsBudget(Sessions::maxMemory);
+        if (current->memoryBudget != 0)
+        {
+            const std::size_t used(totalMemory(current->memory) + peakMatchingMemory() + (live ? live->memory() : 0));
+            sessionsBudget = std::min(sessionsBudget, used < current->memoryBudget ? current->memoryBudget - used : 0);
+        }
+
+        sessions.fit(sessionsBudget);
+    }
+
+    reader.join();
+}
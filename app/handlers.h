@@ -0,0 +1,33 @@
+#pragma once
+#include "corpus.h"
+#include "liveFeed.h"
+#include "request.h"
+#include "search.h"
+
+#include <chrono>
+#include <memory>
+
+// The options of a search request, on top of the defaults given by options
+// Throws if the options aren't valid
+SearchOptions searchRequestOptions(const Request& request, SearchOptions options);
+
+/*
+    What is being said in an episode at a time (in milliseconds from the episode's start, as the subtitles' times are) is requested with
+        :at[\tcontext=<n>]\tepisode=<name>\t<time>
+    Output is as for a search, with a result per episode of that name, which is the number of subtitles showing at the time (see subtitlesShowing),
+    the episode name, the index of the first of them among the subtitles that follow, then those subtitles with n subtitles either side of them
+    for context (2 by default), and an empty line. The subtitles are output as in search results.
+*/
+struct AtRequest
+{
+    episodeName_t episode;
+    std::chrono::milliseconds time;
+    unsigned context;
+};
+
+// Throws if the request isn't a valid :at
+AtRequest parseAtRequest(const Request& request);
+
+// Each request is handled with the version of the corpus current when it's popped
+// The live feed is handled only if live is, see handleRequest
+void handleQueries(const std::shared_ptr<const Corpus>& corpus, const SearchOptions& options, LiveFeed* live);
@@ -1,24 +1,35 @@
+#include "kangaroo.h"
+#include "utility/alphabet.h"
 #include "utility/array.h"
 #include "utility/mismatches.h"
 #include "utility/string.h"
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <initializer_list>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <type_traits>
+#include <vector>
 
 
+// The characters of the string are codes less than alphabetSize, which sizes every node's table of edges
+template<unsigned alphabetSize>
 class SuffixTree
 {
 public:
     struct Node
     {
         unsigned start, end;
-        std::unique_ptr<Node> edges[ALPHABET_SIZE]{};
+        std::unique_ptr<Node> edges[alphabetSize]{};
         Node* suffixLink{nullptr};
 
+        // The characters of the non-null edges as a list threaded through the children, so traversals can skip empty edges
+        // alphabetSize terminates the list
+        unsigned short firstChild{alphabetSize}, nextSibling{alphabetSize};
+
         Node() = default;
 
         Node(unsigned start, unsigned end)
@@ -50,6 +61,13 @@ private:
         return std::make_unique<Node>(begin, end);
     }
 
+    void addEdge(Node* node, unsigned char character, std::unique_ptr<Node> edge)
+    {
+        edge->nextSibling = node->firstChild;
+        node->firstChild = character;
+        node->edges[character] = std::move(edge);
+    }
+
 public:
     String string;
     std::unique_ptr<Node> root{std::make_unique<Node>(0, 0)};
@@ -82,11 +100,11 @@ public:
                 if (active_length == 0)
                     active_edge = &string[pos];
 
-                std::unique_ptr<Node>& edge(active_node->edges[*active_edge]);
+                std::unique_ptr<Node>& edge(active_node->edges[(unsigned char)*active_edge]);
                 if (edge == nullptr)
                 {
                     // If character is not an edge of the active node, add it to the tree
-                    edge = newEdge(pos, std::size(string));
+                    addEdge(active_node, *active_edge, newEdge(pos, std::size(string)));
                     add_SL(suffixLinkSource, active_node);
                 }
                 else
@@ -103,7 +121,7 @@ public:
                     }
 
                     // Active point matches the character, so increase suffix length and move on to next character
-                    if (string[edge->start + active_length] == character)
+                    if ((unsigned char)string[edge->start + active_length] == character)
                     {
                         active_length++;
                         add_SL(suffixLinkSource, active_node);
@@ -113,15 +131,17 @@ public:
                     // Active point doesn't match character, so split the tree here
                     // Add the active point to one branch, the new suffix into the other
                     
-                    // The part of the edge before the split
+                    // The part of the edge before the split, taking the existing edge's place in the active node's list
                     std::unique_ptr<Node> split(newEdge(edge->start, edge->start + active_length));
+                    split->nextSibling = edge->nextSibling;
                     
                     // The part of the existing edge after the split
                     edge->start += active_length;
-                    split->edges[string[edge->start]] = std::move(edge);
+                    const unsigned char edgeCharacter = string[edge->start];
+                    addEdge(split.get(), edgeCharacter, std::move(edge));
                     
                     // The part of the new edge after the split
-                    split->edges[character] = newEdge(pos, std::size(string));
+                    addEdge(split.get(), character, newEdge(pos, std::size(string)));
                     add_SL(suffixLinkSource, split.get());
 
                     // Replace edge from active node with the shortened edge
@@ -149,6 +169,11 @@ public:
         }
     }
 
+    std::size_t memory() const
+    {
+        return n_nodes * sizeof(Node) + std::size(string);
+    }
+
     friend std::ostream& operator<<(std::ostream& stream, const SuffixTree& suffixTree)
     {
         suffixTree.debugPrint(stream);
@@ -185,23 +210,23 @@ class RMQ
 
     Array<unsigned> data;
     Array<unsigned> d;
-    MultiArray<unsigned> RMQ_small;
-    MultiArray<unsigned> RMQ_d;
+    MultiArray<unsigned, 3> RMQ_small; // [d, i_l, i_r]
+    MultiArray<unsigned, 2> RMQ_d;     // Sparse table [y, x], rows padded to a power of two
+    Array<unsigned> logs;              // floor(log_2(i)) for 0 < i <= n_d
 
 public:
     RMQ() = default;
 
-    RMQ(const Array<unsigned>& data_in)
+    RMQ(Array<unsigned> data_in)
+        : data(std::move(data_in))
     {
-        // Requires n >= 2
-        n = std::size(data_in);
-        n_bits = unsigned(std::log2(n)) / 2;
-        data = Array<unsigned>(n);
-        std::copy(std::cbegin(data_in), std::cend(data_in), std::begin(data));
+        // Units of at least one value, or short tours (empty P and T) would have none
+        n = std::size(data);
+        n_bits = std::max(1u, unsigned(std::log2(n)) / 2);
 
         // Precompute the RMQ for all possible values of d and all possible queries
         const unsigned n_values = 1u << n_bits;
-        RMQ_small = MultiArray<unsigned>{n_values, n_bits + 1, n_bits + 1};
+        RMQ_small = MultiArray<unsigned, 3>({n_values, n_bits + 1, n_bits + 1});
         for (unsigned i_d = 0; i_d < n_values; ++i_d)
             for (unsigned i_l = 0; i_l <= n_bits; ++i_l)
             {
@@ -231,7 +256,12 @@ public:
             n_y = unsigned(std::log2(n_d)) + 1;
         
         d = Array<unsigned>(n_d);
-        RMQ_d = MultiArray<unsigned>{n_y, n_d};
+        RMQ_d = MultiArray<unsigned, 2>({n_y, n_d});
+
+        logs = Array<unsigned>(n_d + 1);
+        logs[0] = logs[1] = 0;
+        for (unsigned i = 2; i <= n_d; ++i)
+            logs[i] = logs[i / 2] + 1;
 
         for (unsigned i = 0; i < n_units; ++i)
         {
@@ -269,9 +299,15 @@ public:
                     RMQ_d[{y + 1, x}] = RMQ_d[{y, x + (1 << y)}];
     }
 
+    std::size_t memory() const
+    {
+        return (std::size(data) + std::size(d) + std::size(RMQ_small) + std::size(RMQ_d) + std::size(logs)) * sizeof(unsigned);
+    }
+
     unsigned operator()(unsigned i_l, unsigned i_r) const
     {
-        std::tie(i_l, i_r) = std::minmax({i_l, i_r});
+        if (i_r < i_l)
+            std::swap(i_l, i_r);
         ++i_r; // Transform the inclusive interval [i_l, i_r] -> exclusive [i_l, i_r + 1)
 
         const unsigned
@@ -283,7 +319,7 @@ public:
         // Minimum in i_l_d * n_bits <= min < i_r_d * n_bits
         if (i_l_d < i_r_d)
         {
-            const unsigned l = unsigned(std::log2(i_r_d - i_l_d));
+            const unsigned l = logs[i_r_d - i_l_d];
 
             // Minimum in i_l_d * n_bits <= min < (i_l_d + 2^l) * n_bits
             unsigned i = RMQ_d[{l, i_l_d}];
@@ -327,105 +363,138 @@ public:
 };
 
 
+template<unsigned alphabetSize>
 class LCA
 {
-    // Array of nodes and the depth of the node in the tree in a depth first traversal of the tree
-    Array<unsigned> N, D;
-
-    // Map from node (a value in N) to an index in N; basically N^{-1}
-    Array<unsigned> I;
-
-    // Map from node to length of prefix of suffix (length of suffix for leaves)
+    /*
+        Eulerian tour of the suffix tree, indexed by position in the tour:
+            the depth of the node (kept by the RMQ) and the length of the prefix of suffix it represents
+    */
     Array<unsigned> lengths;
 
-    // Map from index of suffix to node
+    // Map from index of suffix to the position of its leaf in the tour
     Array<unsigned> leaves;
 
     RMQ rmq;
 
-    void depthFirstTraversal(const SuffixTree::Node* node, unsigned depth = 0, unsigned length = 0)
+    struct Frame
     {
-        const unsigned nodeId = lengths.back_i();
-        N.push_back(nodeId);
-        D.push_back(depth);
-        lengths.push_back(length);
+        const typename SuffixTree<alphabetSize>::Node* node;
+        unsigned depth, length;
+        unsigned short nextChild;
+    };
 
-        bool isLeaf(true);
-        for (const std::unique_ptr<SuffixTree::Node>& edge : node->edges)
-            if (edge != nullptr)
+    // Iterative (so that the stack doesn't overflow on long strings) depth first traversal visiting only the non-null edges
+    Array<unsigned> eulerianTour(const SuffixTree<alphabetSize>& tree)
+    {
+        Array<unsigned> D(tree.n_nodes * 2 - 1);
+        const auto visit([&](const Frame& frame)
+        {
+            D.push_back(frame.depth);
+            lengths.push_back(frame.length);
+        });
+
+        std::vector<Frame> stack{{tree.root.get(), 0, 0, tree.root->firstChild}};
+        visit(stack.back());
+        while (!stack.empty())
+        {
+            Frame& frame(stack.back());
+            if (frame.nextChild == alphabetSize)
             {
-                isLeaf = false;
-                depthFirstTraversal(edge.get(), depth + 1, length + edge->edge_length());
-                N.push_back(nodeId);
-                D.push_back(depth);
+                stack.pop_back();
+                if (!stack.empty())
+                    visit(stack.back());
+
+                continue;
             }
 
-        if (isLeaf)
-        {
-            const unsigned suffixIndex(std::size(leaves) - length);
-            leaves[suffixIndex] = nodeId;
+            const typename SuffixTree<alphabetSize>::Node* child(frame.node->edges[frame.nextChild].get());
+            frame.nextChild = child->nextSibling;
+            const Frame childFrame{child, frame.depth + 1, frame.length + child->edge_length(), child->firstChild};
+            if (childFrame.nextChild == alphabetSize)
+                leaves[std::size(leaves) - childFrame.length] = lengths.back_i();
+
+            visit(childFrame);
+            stack.push_back(childFrame);
         }
+
+        return D;
     }
 
 public:
     LCA() = default;
 
-    LCA(const SuffixTree& tree)
+    LCA(const SuffixTree<alphabetSize>& tree)
     {
         /*
-            Construct arrays N and D from an Eulerian tour of the tree.
-            D[i] is the depth of node N[i] at point i of the tour.
-            Constuct an array I such that I[i] = j where i = N[j] for some j.
+            Construct arrays lengths and D from an Eulerian tour of the tree.
+            D[i] is the depth of the node at point i of the tour, lengths[i] is its string depth.
+            Construct an array leaves such that the leaf of suffix i is at point leaves[i] of the tour.
             Preprocess D for range minimum queries.
         */
 
-        const unsigned n = tree.n_nodes;
-
-        lengths = Array<unsigned>(n);
-        N = Array<unsigned>(n * 2 - 1);
-        D = Array<unsigned>(n * 2 - 1);
-        I = Array<unsigned>(n);
+        lengths = Array<unsigned>(tree.n_nodes * 2 - 1);
         leaves = Array<unsigned>(std::size(tree.string));
 
-        depthFirstTraversal(tree.root.get());
-
-        for (unsigned i = 0; i < std::size(N); ++i)
-            I[N[i]] = i;
-
         // Preprocess D for range minimum queries
-        rmq = RMQ(D);
+        rmq = RMQ(eulerianTour(tree));
+    }
+
+    std::size_t memory() const
+    {
+        return (std::size(lengths) + std::size(leaves)) * sizeof(unsigned) + rmq.memory();
     }
 
     unsigned operator()(unsigned i_l, unsigned i_r) const
     {
-        return lengths[N[rmq(I[leaves[i_l]], I[leaves[i_r]])]];
+        return lengths[rmq(leaves[i_l], leaves[i_r])];
     }
 };
 
 
+static std::atomic<std::size_t> matchingMemory{0};
+
+// The suffix tree is freed once the LCA is built from it, but they're both in memory until then
+void recordMatchingMemory(std::size_t bytes)
+{
+    for (std::size_t peak(matchingMemory.load(std::memory_order_relaxed)); bytes > peak && !matchingMemory.compare_exchange_weak(peak, bytes, std::memory_order_relaxed);)
+        ;
+}
+
+std::size_t peakMatchingMemory()
+{
+    return matchingMemory.load(std::memory_order_relaxed);
+}
+
+
+template<unsigned alphabetSize>
 class LCP
 {
     Array<unsigned> lcp;
-    LCA lca;
+    LCA<alphabetSize> lca;
     unsigned n_P, n_T;
     std::string string;
 
 public:
-    LCP(const String& P, const String& T)
+    // The characters of P and T are mapped by alphabet, whose size must be at most alphabetSize
+    LCP(const String& P, const String& T, const Alphabet& alphabet)
     {
+        assert("LCP::LCP: alphabet.size() > alphabetSize" && alphabet.size() <= alphabetSize);
         n_P = std::size(P);
         n_T = std::size(T);
 
-        // Get the concatenation of the strings with terminator symbol
+        // Get the concatenation of the (mapped) strings with terminator symbol
         const unsigned n = n_P + n_T + 1;
 
         string.reserve(n);
-        string.append(std::cbegin(P), std::cend(P));
-        string.append(std::cbegin(T), std::cend(T));
+        for (const String& s : {P, T})
+            std::transform(std::cbegin(s), std::cend(s), std::back_inserter(string), [&](unsigned char c){ return char(alphabet(c)); });
         string.push_back('\0');
 
         // Process for LCA...
-        lca = LCA(SuffixTree(string));
+        const SuffixTree<alphabetSize> tree(string);
+        lca = LCA<alphabetSize>(tree);
+        recordMatchingMemory(tree.memory() + lca.memory());
     }
 
     unsigned operator()(unsigned i_P, unsigned i_T) const
@@ -436,8 +505,41 @@ public:
 };
 
 
+// Number of alignments between polls of the deadline, it's not free to check
+const unsigned deadlinePollInterval = 256;
+
+bool pollDeadline(const Deadline* deadline, unsigned i)
+{
+    return deadline != nullptr && i % deadlinePollInterval == 0 && deadline->expired();
+}
+
+// Number of mismatches of P against T[i:i+m], or k + 1 if there are more than k
+// If positions is given, the indices into P of the (first k) mismatches are appended to it
+template<unsigned alphabetSize>
+unsigned kangarooAlignment(const LCP<alphabetSize>& lcp, unsigned k, unsigned m, unsigned i, std::vector<unsigned>* positions = nullptr)
+{
+    unsigned mismatches = 0;
+    for (unsigned j = 0; j < m;)
+    {
+        // A good optimisation here would be to check if the next two characters mismatch and only otherwise do the lcp query
+        j += lcp(j, i + j) + 1;
+        if (j <= m)
+        {
+            ++mismatches;
+            if (mismatches > k)
+                break;
+
+            if (positions != nullptr)
+                positions->push_back(j - 1);
+        }
+    }
+
+    return mismatches;
+}
+
 // Landau-Vishkin k-mismatch
-Mismatches minKangaroo(unsigned k, const String& P, const String& T)
+template<unsigned alphabetSize>
+Mismatches minKangaroo(unsigned k, const String& P, const String& T, const Alphabet& alphabet, Alignment* best, const Deadline* deadline)
 {
     /*
         Preprocessing T and P for LCP queries is preprocessing the LCA of the suffix tree of T concatenated with P.
@@ -463,26 +565,86 @@ Mismatches minKangaroo(unsigned k, const String& P, const String& T)
     if (n < m)
         return Mismatches{};
 
-    LCP lcp(P, T);
+    LCP<alphabetSize> lcp(P, T, alphabet);
     Mismatches minMismatches(k, k + 1);
+    unsigned i_min = 0;
     
-    for (unsigned i = 0; i < n - m + 1; ++i)
+    // Only an alignment with fewer mismatches than the best so far matters, so alignments are abandoned as soon as they can't be better
+    for (unsigned i = 0; i < n - m + 1 && !pollDeadline(deadline, i); ++i)
     {
-        unsigned mismatches = 0;
-        for (unsigned j = 0; j < m;)
+        const unsigned bound = minMismatches ? unsigned(minMismatches) - 1 : k;
+        if (const Mismatches mismatches(k, kangarooAlignment(lcp, bound, m, i)); mismatches < minMismatches)
         {
-            // A good optimisation here would be to check if the next two characters mismatch and only otherwise do the lcp query
-            j += lcp(j, i + j) + 1;
-            if (j <= m)
-            {
-                ++mismatches;
-                if (mismatches > k)
-                    break;
-            }
+            minMismatches = mismatches;
+            i_min = i;
+            if (unsigned(minMismatches) == 0)
+                break;
         }
+    }
 
-        minMismatches = std::min(minMismatches, Mismatches(k, mismatches));
+    if (best != nullptr && minMismatches)
+    {
+        best->i = i_min;
+        best->mismatches = minMismatches;
+        best->positions.clear();
+        kangarooAlignment(lcp, k, m, i_min, &best->positions);
     }
 
     return minMismatches;
 }
+
+template<unsigned alphabetSize>
+std::vector<Alignment> kangaroo(unsigned k, const String& P, const String& T, const Alphabet& alphabet, bool withPositions, const Deadline* deadline)
+{
+    const unsigned
+        m = std::size(P),
+        n = std::size(T);
+
+    std::vector<Alignment> alignments;
+    if (n < m)
+        return alignments;
+
+    LCP<alphabetSize> lcp(P, T, alphabet);
+    std::vector<unsigned> positions;
+    for (unsigned i = 0; i < n - m + 1 && !pollDeadline(deadline, i); ++i)
+    {
+        positions.clear();
+        if (const unsigned mismatches(kangarooAlignment(lcp, k, m, i, withPositions ? &positions : nullptr)); mismatches <= k)
+            alignments.push_back({i, mismatches, positions});
+    }
+
+    return alignments;
+}
+
+Mismatches minKangaroo(unsigned k, const String& P, const String& T, Alignment* best, const Deadline* deadline)
+{
+    return minKangaroo<ALPHABET_SIZE>(k, P, T, Alphabet(), best, deadline);
+}
+
+std::vector<Alignment> kangaroo(unsigned k, const String& P, const String& T, bool withPositions, const Deadline* deadline)
+{
+    return kangaroo<ALPHABET_SIZE>(k, P, T, Alphabet(), withPositions, deadline);
+}
+
+// Calls f with the smallest alphabet size the engine is instantiated for that fits alphabet (as a std::integral_constant)
+template<typename F>
+auto withAlphabetSize(const Alphabet& alphabet, F f)
+{
+    if (alphabet.size() <= 64)
+        return f(std::integral_constant<unsigned, 64>());
+
+    if (alphabet.size() <= 128)
+        return f(std::integral_constant<unsigned, 128>());
+
+    return f(std::integral_constant<unsigned, ALPHABET_SIZE>());
+}
+
+Mismatches KangarooQuery::match(const String& T, unsigned k, Alignment* best, const Deadline* deadline) const
+{
+    return withAlphabetSize(alphabet, [&](auto alphabetSize){ return minKangaroo<decltype(alphabetSize)::value>(k, pattern(), T, alphabet, best, deadline); });
+}
+
+std::vector<Alignment> KangarooQuery::matchAll(const String& T, unsigned k, bool withPositions, const Deadline* deadline) const
+{
+    return withAlphabetSize(alphabet, [&](auto alphabetSize){ return kangaroo<decltype(alphabetSize)::value>(k, pattern(), T, alphabet, withPositions, deadline); });
+}
@@ -1,6 +1,96 @@
 #pragma once
+#include "utility/alphabet.h"
 #include "utility/array.h"
+#include "utility/deadline.h"
+#include "utility/histogram.h"
 #include "utility/mismatches.h"
 #include "utility/string.h"
+#include <cstddef>
+#include <string>
+#include <vector>
 
-Mismatches minKangaroo(unsigned k, const String& P, const String& T);
+struct Alignment
+{
+    unsigned i;                      // Index into T of the first character of the alignment
+    unsigned mismatches;
+    std::vector<unsigned> positions; // Indices into P of the mismatched characters (only if requested)
+};
+
+/*
+    If there is an alignment with at most k mismatches and best is given, the first alignment with the fewest mismatches is written to best.
+    If deadline is given and expires, the best of the alignments searched so far is returned.
+*/
+Mismatches minKangaroo(unsigned k, const String& P, const String& T, Alignment* best = nullptr, const Deadline* deadline = nullptr);
+
+// All alignments of P in T with at most k mismatches, ordered by i (only those before deadline expired, if given)
+std::vector<Alignment> kangaroo(unsigned k, const String& P, const String& T, bool withPositions = false, const Deadline* deadline = nullptr);
+
+// The most bytes that the structures built for matching against one text (suffix tree, LCA and RMQ) have taken so far
+std::size_t peakMatchingMemory();
+
+
+/*
+    A pattern P preprocessed once, to be matched against any number of texts.
+    Each matching backend derives from this, doing whatever work depends only on P in its constructor.
+*/
+class PreparedQuery
+{
+    std::string P;
+    Histogram<unsigned> histogram_P;
+
+public:
+    PreparedQuery(const std::string& P)
+        : P(P), histogram_P(this->P)
+    {}
+
+    virtual ~PreparedQuery() = default;
+
+    const std::string& pattern() const
+    {
+        return P;
+    }
+
+    const Histogram<unsigned>& histogram() const
+    {
+        return histogram_P;
+    }
+
+    // As minKangaroo(k, P, T, best, deadline)
+    virtual Mismatches match(const String& T, unsigned k, Alignment* best = nullptr, const Deadline* deadline = nullptr) const = 0;
+
+    // As kangaroo(k, P, T, withPositions, deadline)
+    virtual std::vector<Alignment> matchAll(const String& T, unsigned k, bool withPositions = false, const Deadline* deadline = nullptr) const = 0;
+
+    // Bytes taken by the prepared query, as the backend it is
+    virtual std::size_t memory() const = 0;
+
+protected:
+    // Bytes of the pattern on the heap, if it doesn't fit in the capacity of an empty string, see stringMemory
+    std::size_t patternMemory() const
+    {
+        return P.capacity() > std::string().capacity() ? P.capacity() + 1 : 0;
+    }
+};
+
+
+/*
+    Landau-Vishkin k-mismatch, the LCP queries are answered by the suffix tree of P concatenated with each text.
+    The characters are mapped by alphabet, which should cover the texts, so that the suffix trees' nodes are as small as can be.
+*/
+class KangarooQuery : public PreparedQuery
+{
+    Alphabet alphabet;
+
+public:
+    KangarooQuery(const std::string& P, const Alphabet& alphabet = Alphabet())
+        : PreparedQuery(P), alphabet(alphabet)
+    {}
+
+    Mismatches match(const String& T, unsigned k, Alignment* best = nullptr, const Deadline* deadline = nullptr) const override;
+    std::vector<Alignment> matchAll(const String& T, unsigned k, bool withPositions = false, const Deadline* deadline = nullptr) const override;
+
+    std::size_t memory() const override
+    {
+        return sizeof(*this) + patternMemory();
+    }
+};
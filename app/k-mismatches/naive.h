@@ -0,0 +1,103 @@
+#pragma once
+#include "kangaroo.h"
+#include <algorithm>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+    The reference backend, comparing P with every alignment character by character in O(nm).
+    It's too slow to search with, it's what the other backends are checked against.
+*/
+class NaiveQuery : public PreparedQuery
+{
+public:
+    NaiveQuery(const std::string& P)
+        : PreparedQuery(P)
+    {}
+
+    Mismatches match(const String& T, unsigned k, Alignment* best = nullptr, const Deadline* deadline = nullptr) const override
+    {
+        const std::vector<Alignment> alignments(matchAll(T, k, true, deadline));
+        if (alignments.empty())
+            return Mismatches{};
+
+        const auto it_best(std::min_element(std::cbegin(alignments), std::cend(alignments), [](const Alignment& lhs, const Alignment& rhs){ return lhs.mismatches < rhs.mismatches; }));
+        if (best != nullptr)
+            *best = *it_best;
+
+        return Mismatches(k, it_best->mismatches);
+    }
+
+    std::vector<Alignment> matchAll(const String& T, unsigned k, bool withPositions = false, const Deadline* deadline = nullptr) const override
+    {
+        const std::string& P(pattern());
+        const unsigned
+            m = unsigned(std::size(P)),
+            n = std::size(T);
+
+        std::vector<Alignment> alignments;
+        for (unsigned i = 0; i + m <= n && !(deadline != nullptr && deadline->expired()); ++i)
+        {
+            Alignment alignment{i, 0, {}};
+            for (unsigned j = 0; j < m && alignment.mismatches <= k; ++j)
+                if (P[j] != T[i + j])
+                {
+                    ++alignment.mismatches;
+                    if (withPositions && alignment.mismatches <= k)
+                        alignment.positions.push_back(j);
+                }
+
+            if (alignment.mismatches <= k)
+                alignments.push_back(std::move(alignment));
+        }
+
+        return alignments;
+    }
+
+    std::size_t memory() const override
+    {
+        return sizeof(*this) + patternMemory();
+    }
+};
+
+inline std::string describeAlignment(const Alignment& alignment)
+{
+    std::ostringstream description;
+    description << "i = " << alignment.i << ", " << alignment.mismatches << " mismatches at [";
+    for (unsigned j = 0; j < std::size(alignment.positions); ++j)
+        description << (j != 0 ? ", " : "") << alignment.positions[j];
+
+    description << ']';
+    return description.str();
+}
+
+// How the results of tested first differ from those of reference for T and k, nothing if they're the same
+inline std::optional<std::string> findDivergence(const PreparedQuery& tested, const PreparedQuery& reference, const String& T, unsigned k)
+{
+    using namespace std::literals;
+
+    Alignment testedBest{0, 0, {}}, referenceBest{0, 0, {}};
+    const Mismatches
+        testedMismatches = tested.match(T, k, &testedBest),
+        referenceMismatches = reference.match(T, k, &referenceBest);
+
+    if (bool(testedMismatches) != bool(referenceMismatches))
+        return "match found "s + (testedMismatches ? describeAlignment(testedBest) : "nothing"s) + ", expected "s + (referenceMismatches ? describeAlignment(referenceBest) : "nothing"s);
+
+    if (testedMismatches && (testedBest.i != referenceBest.i || testedBest.mismatches != referenceBest.mismatches || testedBest.positions != referenceBest.positions))
+        return "match found "s + describeAlignment(testedBest) + ", expected "s + describeAlignment(referenceBest);
+
+    const std::vector<Alignment>
+        testedAlignments(tested.matchAll(T, k, true)),
+        referenceAlignments(reference.matchAll(T, k, true));
+
+    for (unsigned i = 0; i < std::max(std::size(testedAlignments), std::size(referenceAlignments)); ++i)
+        if (i == std::size(testedAlignments) || i == std::size(referenceAlignments)
+            || testedAlignments[i].i != referenceAlignments[i].i || testedAlignments[i].mismatches != referenceAlignments[i].mismatches || testedAlignments[i].positions != referenceAlignments[i].positions)
+            return "matchAll alignment "s + std::to_string(i) + " found "s + (i < std::size(testedAlignments) ? describeAlignment(testedAlignments[i]) : "nothing"s)
+                + ", expected "s + (i < std::size(referenceAlignments) ? describeAlignment(referenceAlignments[i]) : "nothing"s);
+
+    return std::nullopt;
+}
@@ -0,0 +1,150 @@
+#pragma once
+#include "kangaroo.h"
+#include "utility/circularArray.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+    Matches standing queries against a stream of text as the text arrives, each character once.
+    Each query keeps its open alignments, those that start in the last m - 1 characters and have at most its k mismatches so far,
+    each character extending them and opening one more. An alignment is dropped as soon as it has more than k mismatches, so on text
+    unlike the query few are open at a time, and it's reported once it's m long, when the text it ends in arrives.
+    Nothing is built per piece of text, and the stream is never searched again. Only its end is kept, the last m - 1 characters for the longest query
+    of length m, for opening the alignments of a query added later.
+*/
+class StreamMatcher
+{
+public:
+    struct Hit
+    {
+        unsigned i_query;                // In the order the queries were added
+        std::uint64_t i;                 // Index into the stream of the first character of the alignment
+        unsigned mismatches;
+        std::vector<unsigned> positions; // Indices into the query of the mismatched characters
+    };
+
+private:
+    struct OpenAlignment
+    {
+        std::uint64_t i;
+        unsigned mismatches;
+        std::vector<unsigned> positions;
+    };
+
+    struct StandingQuery
+    {
+        std::unique_ptr<const PreparedQuery> query;
+        unsigned k;
+        std::vector<OpenAlignment> open; // In order of i
+    };
+
+    std::vector<StandingQuery> queries;
+    CircularArray<char> window;
+    unsigned windowSize{0};
+    unsigned n_window{0};
+    std::uint64_t n{0};
+
+    // Extends the query's open alignments by text, which starts at index i_begin into the stream, adding to hits (if given) those that it completes
+    static void extend(StandingQuery& standing, unsigned i_query, std::string_view text, std::uint64_t i_begin, std::vector<Hit>* hits)
+    {
+        const std::string& P(standing.query->pattern());
+        const unsigned m = unsigned(std::size(P));
+        if (m == 0)
+            return;
+
+        std::vector<OpenAlignment>& open(standing.open);
+        for (unsigned j_text = 0; j_text < std::size(text); ++j_text)
+        {
+            const std::uint64_t i_text = i_begin + j_text;
+            open.push_back({i_text, 0, {}});
+
+            // Those still open are kept in order at the front
+            std::size_t n_open = 0;
+            for (OpenAlignment& alignment : open)
+            {
+                const unsigned j = unsigned(i_text - alignment.i);
+                if (P[j] != text[j_text])
+                {
+                    if (++alignment.mismatches > standing.k)
+                        continue;
+
+                    alignment.positions.push_back(j);
+                }
+
+                if (j + 1 != m)
+                    std::swap(open[n_open++], alignment);
+                else if (hits)
+                    hits->push_back({i_query, alignment.i, alignment.mismatches, std::move(alignment.positions)});
+            }
+
+            open.resize(n_open);
+        }
+    }
+
+public:
+    // Returns the index of the query, by which its hits refer to it
+    unsigned add(std::unique_ptr<const PreparedQuery> query, unsigned k)
+    {
+        // Grow the window to what the new query needs, keeping its contents
+        const unsigned m = unsigned(std::size(query->pattern()));
+        if (m > windowSize + 1)
+        {
+            CircularArray<char> grown(m - 1);
+            for (unsigned i = 0; i < n_window; ++i)
+                grown.push(window[i]);
+
+            window = std::move(grown);
+            windowSize = m - 1;
+        }
+
+        // The query's alignments that start in the window may still end in text to come
+        std::string T;
+        for (unsigned i = n_window - std::min(n_window, m != 0 ? m - 1 : 0); i < n_window; ++i)
+            T += window[i];
+
+        queries.push_back({std::move(query), k, {}});
+        extend(queries.back(), unsigned(std::size(queries) - 1), T, n - std::size(T), nullptr);
+        return unsigned(std::size(queries) - 1);
+    }
+
+    // The number of characters pushed so far
+    std::uint64_t size() const
+    {
+        return n;
+    }
+
+    // Bytes taken by the window, the queries and their open alignments
+    std::size_t memory() const
+    {
+        std::size_t bytes(windowSize + queries.capacity() * sizeof(StandingQuery));
+        for (const StandingQuery& standing : queries)
+        {
+            bytes += standing.query->memory() + standing.open.capacity() * sizeof(OpenAlignment);
+            for (const OpenAlignment& alignment : standing.open)
+                bytes += alignment.positions.capacity() * sizeof(unsigned);
+        }
+
+        return bytes;
+    }
+
+    // Appends text to the stream, and to hits the alignments of each query with at most its k mismatches that end in text, by query and then by i
+    void push(std::string_view text, std::vector<Hit>& hits)
+    {
+        for (unsigned i_query = 0; i_query < std::size(queries); ++i_query)
+            extend(queries[i_query], i_query, text, n, &hits);
+
+        if (windowSize != 0)
+            for (char c : text.substr(std::size(text) - std::min<std::size_t>(std::size(text), windowSize)))
+            {
+                window.push(c);
+                n_window = std::min(n_window + 1, windowSize);
+            }
+
+        n += std::size(text);
+    }
+};
@@ -0,0 +1,61 @@
+#pragma once
+#include "mismatches.h"
+#include <algorithm>
+#include <array>
+#include <numeric>
+
+/*
+    A map from bytes to dense codes, so that tables indexed by character need only be as large as the alphabet of the text.
+    Code 0 is left for the terminator and the used bytes are coded from 1.
+    All the other bytes share the last code, which doesn't occur in the text, so they mismatch whatever they're aligned against just as they would unmapped.
+*/
+class Alphabet
+{
+    std::array<unsigned char, ALPHABET_SIZE> codes;
+    unsigned n;
+
+public:
+    // The identity, for when the text's alphabet isn't known
+    Alphabet()
+        : n(ALPHABET_SIZE)
+    {
+        std::iota(std::begin(codes), std::end(codes), 0);
+    }
+
+    // Falls back to the identity if there's no room for the terminator and the unused bytes' codes
+    Alphabet(const std::array<bool, ALPHABET_SIZE>& used)
+        : Alphabet()
+    {
+        const unsigned n_used = unsigned(std::count(std::cbegin(used), std::cend(used), true));
+        if (n_used + 2 > ALPHABET_SIZE)
+            return;
+
+        n = 1;
+        for (unsigned c = 0; c < ALPHABET_SIZE; ++c)
+            if (used[c])
+                codes[c] = (unsigned char)n++;
+
+        for (unsigned c = 0; c < ALPHABET_SIZE; ++c)
+            if (!used[c])
+                codes[c] = (unsigned char)n;
+
+        ++n;
+    }
+
+    unsigned char operator()(unsigned char c) const
+    {
+        return codes[c];
+    }
+
+    // Whether c has a code of its own
+    bool contains(unsigned char c) const
+    {
+        return n == ALPHABET_SIZE || codes[c] != n - 1;
+    }
+
+    // Number of codes, including the terminator
+    unsigned size() const
+    {
+        return n;
+    }
+};
@@ -1,11 +1,9 @@
 #pragma once
 #include "mismatches.h"
 #include <algorithm>
+#include <array>
 #include <cassert>
-#include <functional>
-#include <initializer_list>
 #include <memory>
-#include <numeric>
 #include <ostream>
 
 
@@ -174,45 +172,74 @@ public:
 };
 
 
-template<typename T>
+// Round up to a power of two, returning the exponent
+constexpr unsigned ceilLog2(unsigned x)
+{
+    unsigned ret = 0;
+    while ((1u << ret) < x)
+        ++ret;
+
+    return ret;
+}
+
+template<typename T, unsigned rank>
 class MultiArray
 {
+    static_assert(rank != 0, "MultiArray: rank must be positive");
+
+public:
+    using coordinates_t = std::array<unsigned, rank>;
+
+private:
     Array<T> data;
-    unsigned n;                  // Size of all data (product of dimensions)
-    Array<unsigned> dimensions;  // Dimensions of the multiarray, used for bounds checking
-    Array<unsigned> multipliers; // Multipliers a_i such that coordinates x_i access data[m] where m = x_0 + sum_{i=1} a_{i-1} x_i
+    unsigned n{0};              // Size of all data (product of padded dimensions)
+    coordinates_t dimensions{}; // Dimensions of the multiarray, used for bounds checking
+    coordinates_t shifts{};     // Shifts s_i such that coordinates x_i access data[m] where m = sum_i x_i << s_i
+                                // (row-major, every dimension but the first is padded to a power of two)
+
+    constexpr bool inBounds(const coordinates_t& coordinates) const
+    {
+        for (unsigned i = 0; i < rank; ++i)
+            if (coordinates[i] >= dimensions[i])
+                return false;
+
+        return true;
+    }
+
+    constexpr unsigned index(const coordinates_t& coordinates) const
+    {
+        unsigned i = 0;
+        for (unsigned i_dimension = 0; i_dimension < rank; ++i_dimension)
+            i |= coordinates[i_dimension] << shifts[i_dimension];
+
+        return i;
+    }
 
 public:
     MultiArray() = default;
 
-    MultiArray(std::initializer_list<unsigned> dimensions_in)
+    MultiArray(const coordinates_t& dimensions)
+        : dimensions(dimensions)
     {
-        const unsigned n_dimensions(unsigned(std::size(dimensions_in)));
-
-        dimensions = Array<unsigned>(n_dimensions);
-        std::copy(std::cbegin(dimensions_in), std::cend(dimensions_in), std::begin(dimensions));
-        
-        multipliers = Array<unsigned>(n_dimensions - 1);
-        std::partial_sum(std::crbegin(dimensions), std::crend(dimensions) - 1, std::rbegin(multipliers), std::multiplies<>());
+        for (unsigned i = rank - 1; i != 0; --i)
+            shifts[i - 1] = shifts[i] + ceilLog2(dimensions[i]);
         
-        n = dimensions[0] * multipliers[0];
+        n = dimensions[0] << shifts[0];
         data = Array<T>(n);
     }
 
-    T& operator[](std::initializer_list<unsigned> coordinates)
+    T& operator[](const coordinates_t& coordinates)
     {
-        assert("MultiArray::operator[]: coordinate_i >= dimension_i" && std::inner_product(std::cbegin(coordinates), std::cend(coordinates), std::cbegin(dimensions), true, std::logical_and<>(), std::less<>()));
+        assert("MultiArray::operator[]: coordinate_i >= dimension_i" && inBounds(coordinates));
 
-        const unsigned i = std::inner_product(std::cbegin(coordinates), std::cend(coordinates) - 1, std::cbegin(multipliers), *std::crbegin(coordinates));
-        return data[i];
+        return data[index(coordinates)];
     }
 
-    const T& operator[](std::initializer_list<unsigned> coordinates) const
+    const T& operator[](const coordinates_t& coordinates) const
     {
-        assert("MultiArray::operator[]: coordinate_i >= dimension_i" && std::inner_product(std::cbegin(coordinates), std::cend(coordinates), std::cbegin(dimensions), true, std::logical_and<>(), std::less<>()));
+        assert("MultiArray::operator[]: coordinate_i >= dimension_i" && inBounds(coordinates));
 
-        const unsigned i = std::inner_product(std::cbegin(coordinates), std::cend(coordinates) - 1, std::cbegin(multipliers), *std::crbegin(coordinates));
-        return data[i];
+        return data[index(coordinates)];
     }
 
     T* begin()
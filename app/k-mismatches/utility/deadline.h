@@ -0,0 +1,32 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+
+// A point after which work should be abandoned: a time, and/or a flag that another thread may set to cancel the work
+// It's polled cooperatively; work that finds it has expired stops early with what it has so far, which stopped then tells
+class Deadline
+{
+    std::chrono::steady_clock::time_point time{std::chrono::steady_clock::time_point::max()};
+    const std::atomic<bool>* cancelled{nullptr};
+    mutable bool found{false};
+
+public:
+    Deadline() = default;
+
+    Deadline(std::chrono::steady_clock::time_point time, const std::atomic<bool>* cancelled = nullptr)
+        : time(time), cancelled(cancelled)
+    {}
+
+    bool expired() const
+    {
+        found = found || (cancelled != nullptr && cancelled->load(std::memory_order_relaxed)) || std::chrono::steady_clock::now() >= time;
+        return found;
+    }
+
+    // Whether it has been found expired, and so whether the work polling it stopped early
+    // Work that finished just before it expired isn't reported as stopped, as it was finished before anything polled it
+    bool stopped() const
+    {
+        return found;
+    }
+};
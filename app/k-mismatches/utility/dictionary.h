@@ -0,0 +1,123 @@
+#pragma once
+#include "mismatches.h"
+#include <algorithm>
+#include <array>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/*
+    A static dictionary compressing text by replacing frequent words with single bytes that the text doesn't use.
+    Any byte of the text that happens to be one of those codes is escaped, so text that the dictionary wasn't built from can be compressed as well.
+    A compressed text decodes on its own, so a text compressed piece by piece can be decoded from any piece's start.
+*/
+class TextDictionary
+{
+    std::array<std::string, ALPHABET_SIZE> entries; // By code, empty for a byte that stands for itself
+    std::array<std::vector<unsigned char>, ALPHABET_SIZE> codesByFirst; // Codes of the entries starting with each byte, longest entry first
+    unsigned short escape{ALPHABET_SIZE};           // ALPHABET_SIZE if there are no codes, so nothing needs escaping
+
+public:
+    TextDictionary() = default;
+
+    // Built from the frequencies of the words (with the space after them, if any) of texts
+    template<typename Texts>
+    explicit TextDictionary(const Texts& texts)
+    {
+        std::array<bool, ALPHABET_SIZE> used{};
+        std::unordered_map<std::string_view, unsigned> counts;
+        for (std::string_view text : texts)
+        {
+            for (unsigned char c : text)
+                used[c] = true;
+
+            for (std::size_t i = 0; i < std::size(text);)
+            {
+                const std::size_t i_end(std::min(text.find(' ', i), std::size(text) - 1) + 1);
+                if (i_end - i >= 2)
+                    ++counts[text.substr(i, i_end - i)];
+
+                i = i_end;
+            }
+        }
+
+        std::vector<unsigned char> codes;
+        for (unsigned c = 0; c < ALPHABET_SIZE; ++c)
+            if (!used[c])
+                codes.push_back((unsigned char)c);
+
+        if (codes.empty())
+            return;
+
+        escape = codes.back();
+        codes.pop_back();
+
+        // The bytes saved by an entry, less what it costs to store it
+        const auto savings([](const std::pair<std::string_view, unsigned>& entry){ return long(std::size(entry.first) - 1) * entry.second - long(std::size(entry.first)); });
+        std::vector<std::pair<std::string_view, unsigned>> candidates(std::cbegin(counts), std::cend(counts));
+        std::sort(std::begin(candidates), std::end(candidates), [&](const auto& lhs, const auto& rhs){ return savings(lhs) > savings(rhs) || (savings(lhs) == savings(rhs) && lhs.first < rhs.first); });
+        for (unsigned i = 0; i < std::size(codes) && i < std::size(candidates) && savings(candidates[i]) > 0; ++i)
+        {
+            entries[codes[i]] = std::string(candidates[i].first);
+            codesByFirst[(unsigned char)candidates[i].first[0]].push_back(codes[i]);
+        }
+
+        for (std::vector<unsigned char>& entryCodes : codesByFirst)
+            std::sort(std::begin(entryCodes), std::end(entryCodes), [&](unsigned char lhs, unsigned char rhs){ return std::size(entries[lhs]) > std::size(entries[rhs]); });
+    }
+
+    // Appends the compressed text to out, taking the longest entry at each point
+    void encode(std::string_view text, std::string& out) const
+    {
+        for (std::size_t i = 0; i < std::size(text);)
+        {
+            const unsigned char c = text[i];
+            const std::vector<unsigned char>& codes(codesByFirst[c]);
+            const auto it(std::find_if(std::cbegin(codes), std::cend(codes), [&](unsigned char code){ return text.compare(i, std::size(entries[code]), entries[code]) == 0; }));
+            if (it != std::cend(codes))
+            {
+                out += char(*it);
+                i += std::size(entries[*it]);
+                continue;
+            }
+
+            if (c == escape || !entries[c].empty())
+                out += char(escape);
+
+            out += char(c);
+            ++i;
+        }
+    }
+
+    // Bytes taken by the dictionary, with its entries' and codes' heap memory
+    // An entry is taken to be on the heap if it doesn't fit in the capacity of an empty string, which is that of the string's own buffer if it has one
+    std::size_t memory() const
+    {
+        const std::size_t inlineCapacity(std::string().capacity());
+        std::size_t bytes(sizeof(TextDictionary));
+        for (const std::string& entry : entries)
+            if (entry.capacity() > inlineCapacity)
+                bytes += entry.capacity() + 1;
+
+        for (const std::vector<unsigned char>& entryCodes : codesByFirst)
+            bytes += entryCodes.capacity();
+
+        return bytes;
+    }
+
+    // Appends the decompressed text to out
+    void decode(std::string_view code, std::string& out) const
+    {
+        for (std::size_t i = 0; i < std::size(code); ++i)
+        {
+            const unsigned char c = code[i];
+            if (c == escape && i + 1 < std::size(code))
+                out += code[++i];
+            else if (!entries[c].empty())
+                out += entries[c];
+            else
+                out += char(c);
+        }
+    }
+};
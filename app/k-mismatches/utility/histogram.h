@@ -0,0 +1,64 @@
+#pragma once
+#include "string.h"
+#include <algorithm>
+#include <array>
+#include <limits>
+
+// Characters are folded into a few buckets (letters ignoring case, space, digits, the rest), so that a histogram is small enough to keep per subtitle
+const unsigned HISTOGRAM_SIZE = 32;
+
+constexpr unsigned histogramBucket(unsigned char c)
+{
+    if (c >= 'a' && c <= 'z')
+        return c - 'a';
+
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+
+    if (c == ' ')
+        return 26;
+
+    if (c >= '0' && c <= '9')
+        return 27;
+
+    return 28 + c % 4;
+}
+
+
+// Counts of the characters of a string by bucket, saturating at the maximum of count_t
+template<typename count_t>
+class Histogram
+{
+    std::array<count_t, HISTOGRAM_SIZE> counts{};
+
+public:
+    static constexpr count_t saturated = std::numeric_limits<count_t>::max();
+
+    Histogram() = default;
+
+    Histogram(const String& string)
+    {
+        for (unsigned char c : string)
+            if (count_t& count = counts[histogramBucket(c)]; count != saturated)
+                ++count;
+    }
+
+    // A saturated count is unbounded
+    unsigned operator[](unsigned i_bucket) const
+    {
+        return counts[i_bucket] == saturated ? std::numeric_limits<unsigned>::max() : counts[i_bucket];
+    }
+};
+
+
+// Upper bound on the number of characters of P that match in any alignment of P against T
+// So if this is less than |P| - k, P doesn't occur in T with at most k mismatches
+template<typename count_P_t, typename count_T_t>
+unsigned maxMatches(const Histogram<count_P_t>& P, const Histogram<count_T_t>& T)
+{
+    unsigned n = 0;
+    for (unsigned i = 0; i < HISTOGRAM_SIZE; ++i)
+        n += std::min(P[i], T[i]);
+
+    return n;
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include <cassert>
 #include <string>
+#include <string_view>
 
 // ACHTUNG:
 // this is really just a couple of pointers to positions in a string
@@ -9,7 +10,7 @@
 
 struct String
 {
-    using iterator_t = std::string::const_iterator;
+    using iterator_t = const char*;
 
     iterator_t beginIt, endIt;
     unsigned n;
@@ -17,7 +18,11 @@ struct String
     String() = default;
 
     String(const std::string& string)
-        : beginIt(std::cbegin(string)), endIt(std::cend(string)), n(unsigned(endIt - beginIt))
+        : beginIt(string.data()), endIt(string.data() + std::size(string)), n(unsigned(endIt - beginIt))
+    {}
+
+    String(std::string_view string)
+        : beginIt(string.data()), endIt(string.data() + std::size(string)), n(unsigned(endIt - beginIt))
     {}
 
     String(iterator_t begin, iterator_t end)
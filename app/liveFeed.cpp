@@ -0,0 +1,110 @@
+#include "liveFeed.h"
+#include "memoryUsage.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+using namespace std::literals;
+
+unsigned LiveFeed::subtitleAt(std::uint64_t i) const
+{
+    return unsigned(std::upper_bound(std::cbegin(subtitles), std::cend(subtitles), i, [](std::uint64_t i, const LiveSubtitle& subtitle){ return i < subtitle.i_begin; }) - std::cbegin(subtitles) - 1);
+}
+
+SearchOptions LiveFeed::watchOptions(const Request& request, const SearchOptions& defaultOptions)
+{
+    SearchOptions options(defaultOptions);
+    for (const auto& [name, value] : request.options)
+        if (name != "id"s)
+            setSearchOption(options, name, value);
+
+    if (request.argument.empty())
+        throw std::runtime_error("Expected a query to watch for"s);
+
+    return options;
+}
+
+Subtitle LiveFeed::feedSubtitle(const Request& request)
+{
+    const auto time([&](const std::string& name)
+    {
+        const auto it(request.options.find(name));
+        try
+        {
+            if (it != std::end(request.options))
+                return std::chrono::milliseconds(std::stoll(it->second));
+        }
+        catch (const std::logic_error&)
+        {
+        }
+
+        throw std::runtime_error("Expected the "s + name + " option to be a number of milliseconds"s);
+    });
+
+    return {time("begin"s), time("end"s), request.argument};
+}
+
+void LiveFeed::watch(const Request& request, const SearchOptions& defaultOptions)
+{
+    const SearchOptions options(watchOptions(request, defaultOptions));
+    const unsigned m = unsigned(std::size(request.argument));
+    const auto it_id(request.options.find("id"s));
+    matcher.add(std::make_unique<const KangarooQuery>(request.argument), mismatchBudget(m, options));
+    queries.push_back({it_id != std::end(request.options) ? it_id->second : request.argument, m, options});
+    m_max = std::max(m_max, m);
+}
+
+std::size_t LiveFeed::memory() const
+{
+    std::size_t bytes(matcher.memory() + vectorMemory(queries) + std::size(subtitles) * sizeof(LiveSubtitle));
+    for (const StandingQuery& query : queries)
+        bytes += stringMemory(query.name);
+    for (const LiveSubtitle& subtitle : subtitles)
+        bytes += stringMemory(subtitle.subtitle.text);
+
+    return bytes;
+}
+
+void LiveFeed::feed(const Request& request)
+{
+    Subtitle subtitle(feedSubtitle(request));
+
+    // Consecutive subtitles are separated as in an episode's text
+    const std::string text(matcher.size() != 0 ? subtitleSeparator + request.argument : request.argument);
+    subtitles.push_back({matcher.size() + std::size(text) - std::size(request.argument), std::move(subtitle)});
+
+    std::vector<StreamMatcher::Hit> hits;
+    matcher.push(text, hits);
+
+    // By similarity, index of the query, result
+    std::vector<std::tuple<float, unsigned, QueryResult>> results;
+    for (StreamMatcher::Hit& hit : hits)
+    {
+        const StandingQuery& query(queries[hit.i_query]);
+        const unsigned
+            i_first = subtitleAt(hit.i),
+            i_last = subtitleAt(hit.i + query.m - 1);
+
+        QueryResult result{hit.mismatches, query.name, {}, unsigned(hit.i - subtitles[i_first].i_begin), std::move(hit.positions)};
+        for (unsigned i = i_first; i <= i_last; ++i)
+            result.subtitles.push_back(subtitles[i].subtitle);
+
+        results.emplace_back(similarity(hit.mismatches, query.m, query.options), hit.i_query, std::move(result));
+    }
+
+    std::stable_sort(std::begin(results), std::end(results), [](const auto& lhs, const auto& rhs){ return std::get<0>(lhs) > std::get<0>(rhs); });
+    std::cout << std::size(results) << '\n';
+    for (const auto& [score, i_query, result] : results)
+        printResults({result}, queries[i_query].m, queries[i_query].options);
+
+    std::cout << std::flush;
+
+    // A match still to come starts in the last m_max - 1 characters at the earliest
+    while (std::size(subtitles) > 1 && subtitles[1].i_begin + m_max <= matcher.size() + 1)
+        subtitles.pop_front();
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "corpus.h"
+#include "request.h"
+#include "search.h"
+#include "k-mismatches/streamMatcher.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+/*
+    Subtitles arriving live, as in a broadcast, matched against standing queries as they arrive instead of once they've been loaded from a file.
+        :watch[\t<option>=<value>]...\t<query>
+    adds a standing query with the search options given, whose results are named by its id option if it has one, by the query otherwise.
+    The output is that of a search with no results. Then
+        :feed\tbegin=<milliseconds>\tend=<milliseconds>\t<text>
+    adds a subtitle to the feed. The output is that of a search, of the standing queries' matches that end in the subtitle, best first,
+    with the name of the query in place of the episode name. The feed is matched as one text, as with the episode-text option.
+*/
+class LiveFeed
+{
+    struct StandingQuery
+    {
+        std::string name;
+        unsigned m;
+        SearchOptions options;
+    };
+
+    struct LiveSubtitle
+    {
+        std::uint64_t i_begin; // Index into the feed's text
+        Subtitle subtitle;
+    };
+
+    StreamMatcher matcher;
+    std::vector<StandingQuery> queries;
+    unsigned m_max{0};
+
+    // The subtitles that a match still to come can start in, oldest first
+    std::deque<LiveSubtitle> subtitles;
+
+    // Index into subtitles of the subtitle whose text (or following separator) contains the feed's text[i]
+    unsigned subtitleAt(std::uint64_t i) const;
+
+public:
+    // The options of a standing query, on top of the defaults, throws if the request isn't a valid :watch
+    static SearchOptions watchOptions(const Request& request, const SearchOptions& defaultOptions);
+
+    // Throws if the request isn't a valid :feed
+    static Subtitle feedSubtitle(const Request& request);
+
+    void watch(const Request& request, const SearchOptions& defaultOptions);
+
+    std::size_t memory() const;
+
+    void feed(const Request& request);
+};
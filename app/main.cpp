@@ -1,296 +1,119 @@
-#include "k-mismatches/kangaroo.h"
-
-#include <algorithm>
-#include <chrono>
-#include <deque>
+#include "coordinator.h"
+#include "corpus.h"
+#include "corpusImage.h"
+#include "corpusWatcher.h"
+#include "handlers.h"
+#include "liveFeed.h"
+#include "memoryUsage.h"
+#include "search.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
 #include <experimental/filesystem>
-#include <fstream>
-#include <initializer_list>
-#include <iomanip>
 #include <iostream>
-#include <iterator>
-#include <list>
-#include <numeric>
-#include <regex>
-#include <sstream>
+#include <memory>
+#include <stdexcept>
 #include <string>
-#include <string_view>
-#include <tuple>
-#include <unordered_map>
-#include <utility>
 #include <vector>
 
 using namespace std::literals;
 
-const static unsigned maxMismatches = 16;
-
-using episodeName_t = std::string;
-
-struct Subtitle
-{
-    std::chrono::milliseconds time_begin, time_end;
-    std::string text;
-};
-
-struct Episode
-{
-    episodeName_t name;
-    std::deque<Subtitle> subtitles;
-};
-
-struct EpisodeNameAndOffset
-{
-    std::string name;
-    std::chrono::milliseconds offset;
-};
-
-struct QueryResult
-{
-    unsigned mismatches;
-    episodeName_t episodeName;
-    Subtitle subtitle;
-};
-
-using offsets_t = std::unordered_map<episodeName_t, std::chrono::milliseconds>;
-
-std::vector<std::string> split(std::string text, std::string delimiter)
-{
-    std::vector<std::string> ret;
-    auto it_from(std::begin(text));
-    for (;;)
-    {
-        auto it_to(std::search(it_from, std::end(text), std::begin(delimiter), std::end(delimiter)));
-        ret.push_back(std::string(it_from, it_to));
-            
-        if (it_to == std::end(text))
-            break;
-
-        it_from = it_to + std::size(delimiter);
-    }
-
-    return ret;
-}
-
 std::string usage(std::string program)
 {
     if (program.empty())
         program = "<this executable>"s;
 
-    return program + " <videos directory> <subtitles directory> <offsets filepath>\n"s;
-}
-
-offsets_t loadOffsets(const std::experimental::filesystem::path& filepath)
-{
-    offsets_t ret;
-    std::ifstream in(filepath);
-    for (auto [i_line, line](std::tuple<unsigned, std::string>{}); std::getline(in, line); ++i_line)
-    {
-        if (std::empty(line))
-            continue;
-
-        std::smatch match;
-        std::regex_match(line, match, std::regex(R"((.*): (-?\d+)\s*)"));
-        if (std::size(match) != 3)
-        {
-            std::clog
-                << "Warning: syntax error on line "s << i_line + 1 << " of map file "s << filepath << ":\n"s
-                << line << '\n';
-            
-            continue;
-        }
-
-        ret[match[1]] = std::stoll(match[2]) * 1ms;
-    }
-
-    return ret;
-}
-
-std::chrono::milliseconds loadTime(const std::string& in)
-{
-    std::smatch match;
-    std::regex_match(in, match, std::regex(R"((\d+):(\d+):(\d+)\.(\d+))"));
-    if (std::size(match) != 5)
-        throw std::runtime_error("Time '"s + in + "' does not match expected format"s);
-
-    return std::stoul(match[1]) * 1h + std::stoul(match[2]) * 1min + std::stoul(match[3]) * 1s + std::stoul(match[4]) * 1ms;
-}
-
-Subtitle loadSubtitle(const std::string& in)
-{
-    Subtitle subtitle;
-    std::smatch match;
-    std::regex_match(in, match, std::regex(R"((\d+:\d+:\d+\.\d+), (\d+:\d+:\d+\.\d+), *(.*))"));
-    if (std::size(match) != 4)
-        throw std::runtime_error("Subtitle '"s + in + "' does not match expected format"s);
-
-    try
-    {
-        subtitle.time_begin = loadTime(match[1]);
-        subtitle.time_end = loadTime(match[2]);
-        subtitle.text = match[3];
-    }
-    catch (const std::exception& e)
-    {
-        throw std::runtime_error("Error parsing subtitle '"s + in + "': "s + e.what());
-    }
-
-    return subtitle;
+    return
+        program + " <videos directory> <subtitles directory> <offsets filepath> [--<option>[=<value>]]...\n"s
+        + "Startup options:\n"s
+        + "    progressive (answer queries while the corpus is loading)\n"s
+        + "    compress-text (keep the subtitles' text compressed in memory)\n"s
+        + "    memory-budget=<megabytes> (per process, drop caches and then the word index and histograms to keep within it)\n"s
+        + "    corpus-image=<filepath> (share the corpus with other processes)\n"s
+        + "    shard=<i>/<n> (load only the ith of n shards of the subtitles files)\n"s
+        + "    shards=<n> (start a process for each of n shards and coordinate them)\n"s
+        + "Search options: episode-text, words, stream, budget, mismatch-ratio, max-mismatches, min-similarity, scoring, episode, episode-pattern, from, to, session, verify, limit\n"s;
 }
 
-std::vector<Subtitle> loadSubtitles(const std::experimental::filesystem::path& filepath)
+int main(int argc, char* argv[])
 {
-    std::vector<Subtitle> ret;
-    std::ifstream subtitleFile(filepath);
-    for (auto [i_line, line](std::tuple<unsigned, std::string>{}); std::getline(subtitleFile, line); ++i_line)
-        try
-        {
-            if (!line.empty())
-                ret.push_back(loadSubtitle(line));
-        }
-        catch (const std::exception& e)
-        {
-            std::clog
-                << "Warning: error on line "s << i_line + 1 << " of subtitle file "s << filepath << ":\n"s
-                << e.what() << '\n';
+    const std::vector<std::string> args(argv, argv + argc);
+    if (std::size(args) < 4)
+        return std::cerr << usage(args[0]), EXIT_FAILURE;
 
-            continue;
-        }
+    const std::experimental::filesystem::path videoDirectory(args[1]), subtitlesDirectory(args[2]), offsetsFilepath(args[3]);
 
-    return ret;
-}
+    SearchOptions options;
+    bool progressive(false), compressText(false);
+    std::size_t memoryBudget(0);
+    std::experimental::filesystem::path corpusImageFilepath;
+    Shard shard;
+    unsigned n_shards(0);
 
-std::vector<EpisodeNameAndOffset> pairEpisodeNameAndOffsets(std::vector<std::string> episodeNames, const offsets_t& offsets)
-{
-    std::vector<EpisodeNameAndOffset> ret;
-    for (const std::string name : episodeNames)
+    // The shard processes get the same arguments, except for the shards option
+    std::vector<std::string> shardArgs(std::cbegin(args) + 1, std::cbegin(args) + 4);
+    for (auto it(std::cbegin(args) + 4); it != std::cend(args); ++it)
         try
         {
-            ret.push_back(EpisodeNameAndOffset{name, offsets.at(name)});
-        }
-        catch (const std::exception& e)
-        {
-            std::clog
-                << "Warning: error getting offset for episode '"s << name << "'\n:"s
-                << e.what() << '\n';
-        }
-
-    return ret;
-}
-
-std::list<Episode> loadMultiEpisode(const std::experimental::filesystem::path& filepath, const offsets_t& offsets)
-{
-    std::clog << "Loading episodes: "s << filepath.stem().u8string() << '\n';
-    
-    std::vector<std::string> episodeNames(split(filepath.stem().u8string(), " - "s));
-    std::vector<EpisodeNameAndOffset> episodeNameAndOffsets(pairEpisodeNameAndOffsets(episodeNames, offsets));
-    std::sort(std::begin(episodeNameAndOffsets), std::end(episodeNameAndOffsets), [](const EpisodeNameAndOffset& lhs, const EpisodeNameAndOffset& rhs){ return lhs.offset < rhs.offset; });
-
-    std::vector<Subtitle> subtitles(loadSubtitles(filepath));
-    std::list<Episode> ret;
-    {
-        auto it_episodeAndOffset(std::rbegin(episodeNameAndOffsets)), it_end_episodeAndOffset(std::rend(episodeNameAndOffsets));
-        if (it_episodeAndOffset == it_end_episodeAndOffset)
-            return ret;
-
-        Episode episode{it_episodeAndOffset->name};
-        for (auto it(std::rbegin(subtitles)), it_end(std::rend(subtitles)); it != it_end; ++it)
-        {
-            if (it->time_begin < it_episodeAndOffset->offset)
+            if (it->compare(0, 2, "--"s) != 0)
+                throw std::runtime_error("Expected an option, got '"s + *it + "'"s);
+
+            const std::size_t i_equals(it->find('='));
+            const std::string name(it->substr(2, i_equals - 2)), value(i_equals == std::string::npos ? "1"s : it->substr(i_equals + 1));
+            if (name == "progressive"s)
+                progressive = parseFlag(value);
+            else if (name == "compress-text"s)
+                compressText = parseFlag(value);
+            else if (name == "memory-budget"s)
+                memoryBudget = std::size_t(std::stod(value) * (1 << 20));
+            else if (name == "corpus-image"s)
+                corpusImageFilepath = value;
+            else if (name == "shard"s)
             {
-                ++it_episodeAndOffset;
-                if (it_episodeAndOffset == it_end_episodeAndOffset)
-                    break;
-
-                ret.push_front(episode);
-                episode = Episode{it_episodeAndOffset->name};
+                const std::size_t i_slash(value.find('/'));
+                shard = Shard{unsigned(std::stoul(value.substr(0, i_slash))), i_slash == std::string::npos ? 0 : unsigned(std::stoul(value.substr(i_slash + 1)))};
+                if (shard.i >= shard.n)
+                    throw std::runtime_error("Expected shard=<i>/<n> with i < n, got '"s + value + "'"s);
             }
+            else if (name == "shards"s)
+                n_shards = unsigned(std::stoul(value));
+            else
+                setSearchOption(options, name, value);
 
-            episode.subtitles.push_front(Subtitle{it->time_begin - it_episodeAndOffset->offset, it->time_end - it_episodeAndOffset->offset, it->text});
-        }
-
-        ret.push_front(episode);
-    }
-
-    return ret;
-}
-
-std::list<Episode> loadEpisodes(const std::experimental::filesystem::path& subtitlesDirectory, const offsets_t& offsets)
-{
-    std::list<Episode> episodes;
-    for (std::experimental::filesystem::path path : std::experimental::filesystem::directory_iterator(subtitlesDirectory))
-        try
-        {
-            episodes.splice(std::end(episodes), loadMultiEpisode(path, offsets));
+            if (name != "shards"s)
+                shardArgs.push_back(*it);
         }
         catch (const std::exception& e)
         {
-            std::clog
-                << "Warning: could not load episodes for subtitles file '"s << path << "'\n"s
-                << e.what() << '\n';
+            return std::cerr << e.what() << '\n' << usage(args[0]), EXIT_FAILURE;
         }
 
-    return episodes;
-}
-
-std::vector<QueryResult> searchEpisode(const Episode& episode, const std::string& query)
-{
-    std::vector<QueryResult> results;
-    for (const Subtitle& subtitle : episode.subtitles)
-        if (Mismatches minMismatches(minKangaroo(std::size(query) / 4, query, subtitle.text)); minMismatches)
-            results.push_back({minMismatches, episode.name, subtitle});
-
-    return results;
-}
-
-std::vector<QueryResult> searchEpisodes(const std::list<Episode>& episodes, const std::string& query)
-{
-    std::vector<QueryResult> results;
-    for (const Episode& episode : episodes)
-        if (std::vector<QueryResult> result(searchEpisode(episode, query)); !result.empty())
-            results.insert(std::end(results), std::make_move_iterator(std::begin(result)), std::make_move_iterator(std::end(result)));
-
-    return results;
-}
-
-void handleQuery(const std::list<Episode>& episodes, const std::string& query)
-{
-    std::vector<QueryResult> results(searchEpisodes(episodes, query));
-    std::sort(std::begin(results), std::end(results), [](const QueryResult& lhs, const QueryResult& rhs){ return lhs.mismatches < rhs.mismatches; });
-    std::cout << std::size(results) << '\n';
-    for (const QueryResult& result : results)
-    {
-        std::cout
-            << 1 - float(result.mismatches) / (maxMismatches + 1) << '\n'
-            << result.episodeName << '\n'
-            << result.subtitle.time_begin.count() << ", " << result.subtitle.time_end.count() << ", " << result.subtitle.text << '\n'
-            << '\n';
-    }
-}
-
-void handleQueries(const std::list<Episode>& episodes)
-{
-    for (std::string query; std::getline(std::cin, query);)
+    if (n_shards != 0)
         try
         {
-            handleQuery(episodes, query);
+            coordinateQueries(shardArgs, n_shards, options);
+            return EXIT_SUCCESS;
         }
         catch (const std::exception& e)
         {
-            std::clog
-                << "Warning: error handling query '"s << query << "':\n"s
-                << e.what() << '\n';
+            return std::cerr << e.what() << '\n', EXIT_FAILURE;
         }
-}
-
-int main(int argc, char* argv[])
-{
-    const std::vector<std::string> args(argv, argv + argc);
-    if (std::size(args) != 4)
-        return std::cerr << usage(args[0]), EXIT_FAILURE;
-
-    const std::experimental::filesystem::path videoDirectory(args[1]), subtitlesDirectory(args[2]), offsetsFilepath(args[3]);
 
-    offsets_t offsets(loadOffsets(offsetsFilepath));
-    const std::list<Episode> episodes(loadEpisodes(subtitlesDirectory, offsets));
-    handleQueries(episodes);
+    // Each shard has its own image
+    if (!corpusImageFilepath.empty() && shard.n != 1)
+        corpusImageFilepath += "."s + std::to_string(shard.i) + "of"s + std::to_string(shard.n);
+
+    // Progressive loading and compressing the text don't apply when sharing a corpus image
+    Corpus loaded(corpusImageFilepath.empty()
+        ? loadCorpus(subtitlesDirectory, offsetsFilepath, shard, progressive, compressText)
+        : loadSharedCorpus(corpusImageFilepath, subtitlesDirectory, offsetsFilepath, shard));
+    loaded.memoryBudget = memoryBudget;
+    fitMemoryBudget(loaded);
+
+    std::shared_ptr<const Corpus> corpus(std::make_shared<Corpus>(std::move(loaded)));
+    CorpusWatcher watcher(corpus, subtitlesDirectory, offsetsFilepath, shard);
+    // Of the shards, the first handles the live feed
+    LiveFeed live;
+    handleQueries(corpus, options, shard.i == 0 ? &live : nullptr);
 }
@@ -0,0 +1,138 @@
+#include "memoryUsage.h"
+#include "wordIndex.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+
+using namespace std::literals;
+
+std::size_t stringMemory(const std::string& string)
+{
+    static const std::size_t inlineCapacity(std::string().capacity());
+    return string.capacity() > inlineCapacity ? string.capacity() + 1 : 0;
+}
+
+std::size_t wordIndexMemory(const WordIndex& index)
+{
+    std::size_t bytes(
+        sizeof(WordIndex) + index.ids.bucket_count() * sizeof(void*) + std::size(index.ids) * (sizeof(std::pair<const std::string, unsigned>) + nodeMemory)
+        + vectorMemory(index.postings) + vectorMemory(index.words) + vectorMemory(index.episodes) + vectorMemory(index.sortedIds));
+
+    for (const auto& [word, id] : index.ids)
+        bytes += stringMemory(word);
+    for (const std::vector<WordIndex::Posting>& postings : index.postings)
+        bytes += vectorMemory(postings);
+    for (const std::string& word : index.words)
+        bytes += stringMemory(word);
+
+    return bytes;
+}
+
+memoryUsage_t corpusMemory(const Corpus& corpus)
+{
+    memoryUsage_t usage{{"corpus image"s, 0}, {"dictionary"s, 0}, {"episodes"s, 0}, {"histograms"s, 0}, {"offsets"s, 0}, {"subtitles"s, 0}, {"text"s, 0}, {"word index"s, 0}};
+    usage["offsets"s] = corpus.offsets.bucket_count() * sizeof(void*) + std::size(corpus.offsets) * (sizeof(std::pair<const episodeName_t, std::chrono::milliseconds>) + nodeMemory);
+    for (const auto& [name, offset] : corpus.offsets)
+        usage["offsets"s] += stringMemory(name);
+
+    usage["episodes"s] = vectorMemory(corpus.files) + vectorMemory(corpus.episodes) + hashTableMemory(corpus.episodesByName);
+    for (const auto& [name, i] : corpus.episodesByName)
+        usage["episodes"s] += stringMemory(name);
+
+    for (const SubtitlesFile& file : corpus.files)
+    {
+        if (file.words)
+            usage["word index"s] += wordIndexMemory(*file.words);
+
+        for (const Episode& episode : *file.episodes)
+        {
+            usage["episodes"s] += sizeof(Episode) + nodeMemory + stringMemory(episode.name);
+
+            const std::size_t
+                subtitles = std::size(episode.subtitles) * (sizeof(SubtitleTimes) + sizeof(unsigned)) + std::size(episode.latestEnds) * sizeof(std::chrono::milliseconds),
+                text = std::size(episode.text) + std::size(episode.compressedText) + std::size(episode.compressedBegins) * sizeof(unsigned),
+                histograms = std::size(episode.histograms) * sizeof(Histogram<std::uint8_t>);
+
+            if (file.mapped)
+                usage["corpus image"s] += subtitles + text + histograms;
+            else
+            {
+                usage["subtitles"s] += subtitles;
+                usage["text"s] += text;
+                usage["histograms"s] += histograms;
+            }
+        }
+    }
+
+    if (corpus.dictionary)
+        usage["dictionary"s] = corpus.dictionary->memory();
+
+    return usage;
+}
+
+std::size_t totalMemory(const memoryUsage_t& usage)
+{
+    return std::accumulate(std::cbegin(usage), std::cend(usage), std::size_t(0), [](std::size_t total, const auto& component){ return total + component.second; });
+}
+
+// The episode, sharing the rest of its data, without its histograms, which are freed once no version of the corpus has the episode with them
+Episode withoutHistograms(const Episode& episode)
+{
+    Episode stripped(episode);
+    stripped.histograms = {};
+    stripped.histogramStorage = nullptr;
+    return stripped;
+}
+
+void fitMemoryBudget(Corpus& corpus)
+{
+    for (;;)
+    {
+        if (!corpus.wordIndex)
+            for (SubtitlesFile& file : corpus.files)
+                file.words = nullptr;
+
+        if (!corpus.histograms)
+        {
+            bool stripped(false);
+            for (SubtitlesFile& file : corpus.files)
+                if (!file.mapped && std::any_of(std::cbegin(*file.episodes), std::cend(*file.episodes), [](const Episode& episode){ return episode.histogramStorage != nullptr; }))
+                {
+                    auto episodes(std::make_shared<std::list<Episode>>());
+                    for (const Episode& episode : *file.episodes)
+                        episodes->push_back(withoutHistograms(episode));
+
+                    file.episodes = std::move(episodes);
+                    stripped = true;
+                }
+
+            // The episodes have moved
+            if (stripped)
+                indexEpisodes(corpus);
+        }
+
+        corpus.memory = corpusMemory(corpus);
+        const std::size_t total(totalMemory(corpus.memory));
+        if (corpus.memoryBudget == 0 || total <= corpus.memoryBudget)
+            return;
+
+        std::clog << "Warning: the corpus takes "s << total << " bytes, over the memory budget of "s << corpus.memoryBudget << " bytes, "s;
+        if (corpus.wordIndex)
+        {
+            std::clog << "dropping the word index: searching by word and completing will find nothing\n"s;
+            corpus.wordIndex = false;
+        }
+        else if (corpus.histograms && std::any_of(std::cbegin(corpus.files), std::cend(corpus.files), [](const SubtitlesFile& file){ return !file.mapped; }))
+        {
+            std::clog << "dropping the subtitles' histograms: searches will be slower\n"s;
+            corpus.histograms = false;
+        }
+        else
+        {
+            std::clog << "even without its optional structures\n"s;
+            return;
+        }
+    }
+}
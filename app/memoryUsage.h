@@ -0,0 +1,45 @@
+#pragma once
+#include "corpus.h"
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// The heap memory of a string, none if it's short enough to be kept in the string itself
+// That's taken to be if it fits in the capacity of an empty string, which is that of the string's own buffer if it has one
+std::size_t stringMemory(const std::string& string);
+
+template<typename T>
+std::size_t vectorMemory(const std::vector<T>& vector)
+{
+    return vector.capacity() * sizeof(T);
+}
+
+// The links of a node of a list or hash table, besides its element
+const std::size_t nodeMemory = 2 * sizeof(void*);
+
+template<typename Key, typename T>
+std::size_t hashTableMemory(const std::unordered_multimap<Key, T>& table)
+{
+    return table.bucket_count() * sizeof(void*) + std::size(table) * (sizeof(std::pair<const Key, T>) + nodeMemory);
+}
+
+/*
+    The memory of the corpus by component, estimated from the sizes of its containers: their elements, the memory they own and the links of their nodes,
+    without the allocator's overhead. Every component is listed, so that those dropped show as taking nothing.
+    The subtitles, text and histograms of episodes that view a corpus image are counted as the corpus image's, as they're shared with the other processes that map it.
+*/
+memoryUsage_t corpusMemory(const Corpus& corpus);
+
+std::size_t totalMemory(const memoryUsage_t& usage);
+
+/*
+    Tallies the memory of the (indexed) corpus into corpus.memory, having dropped its optional structures for as long as it's over its memory budget:
+    first the word index, without which searching by word and completing find nothing, then the subtitles' histograms, without which every subtitle is matched.
+    Once dropped, they're not built for the files loaded afterwards, so each version of the corpus is fitted before it's published.
+    The histograms of a corpus image can't be dropped, as the image is shared.
+    The sessions' caches have what the corpus leaves of the budget, up to Sessions::maxMemory (see handleQueries), so in effect they're the first to go.
+*/
+void fitMemoryBudget(Corpus& corpus);
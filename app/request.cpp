@@ -0,0 +1,115 @@
+#include "request.h"
+#include "corpus.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+using namespace std::literals;
+
+Request parseRequest(const std::string& line)
+{
+    if (line.empty() || line[0] != ':')
+        return Request{""s, {}, line};
+
+    const std::vector<std::string> fields(split(line.substr(1), "\t"s));
+    Request request{fields[0], {}, {}};
+    if (std::size(fields) == 1)
+        return request;
+
+    for (auto it(std::cbegin(fields) + 1); it != std::cend(fields) - 1; ++it)
+    {
+        const std::size_t i_equals(it->find('='));
+        if (i_equals == std::string::npos)
+            throw std::runtime_error("Option '"s + *it + "' is not of the form <option>=<value>"s);
+
+        request.options.emplace(it->substr(0, i_equals), it->substr(i_equals + 1));
+    }
+
+    request.argument = fields.back();
+    return request;
+}
+
+bool isCancellation(const std::string& line)
+{
+    return line == ":cancel"s || line.compare(0, 8, ":cancel\t"s) == 0;
+}
+
+void printError(const std::string& message)
+{
+    std::string line(message);
+    std::replace(std::begin(line), std::end(line), '\n', ' ');
+    std::cout << "error "s << line << '\n' << std::flush;
+}
+
+void RequestQueue::cancel(const std::string& id)
+{
+    for (const auto& [requestId, flag] : cancellations)
+        if (id.empty() || requestId == id)
+            if (const std::shared_ptr<std::atomic<bool>> cancelled = flag.lock())
+                *cancelled = true;
+}
+
+void RequestQueue::prune()
+{
+    for (auto it(std::begin(cancellations)); it != std::end(cancellations);)
+        if (it->second.expired())
+            it = cancellations.erase(it);
+        else
+            ++it;
+}
+
+void RequestQueue::push(QueuedRequest request)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    requests.push_back(std::move(request));
+    condition.notify_one();
+}
+
+void RequestQueue::close()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    condition.notify_one();
+}
+
+void RequestQueue::read(std::istream& in)
+{
+    for (std::string line; std::getline(in, line);)
+        try
+        {
+            Request request(parseRequest(line));
+            if (request.command == "cancel"s)
+            {
+                cancel(request.argument);
+                continue;
+            }
+
+            prune();
+            const auto cancelled(std::make_shared<std::atomic<bool>>(false));
+            const auto it_id(request.options.find("id"s));
+            cancellations.emplace(it_id != std::end(request.options) ? it_id->second : ""s, cancelled);
+            push(QueuedRequest{line, std::move(request), cancelled, ""s});
+        }
+        catch (const std::exception& e)
+        {
+            // Answered in turn, unless it's a cancellation, which never is
+            if (!isCancellation(line))
+                push(QueuedRequest{line, {}, nullptr, e.what()});
+        }
+
+    close();
+}
+
+std::optional<QueuedRequest> RequestQueue::pop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [&]{ return closed || !requests.empty(); });
+    if (requests.empty())
+        return std::nullopt;
+
+    QueuedRequest request(std::move(requests.front()));
+    requests.pop_front();
+    return request;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+// A line of input is either a plain query or a command of the form
+//     :<command>[\t<option>=<value>]...[\t<argument>]
+// Every request but :cancel is answered, in order, and one that can't be handled is answered with an error, see printError
+struct Request
+{
+    std::string command; // Empty for a plain query
+    std::unordered_multimap<std::string, std::string> options;
+    std::string argument;
+};
+
+struct QueuedRequest
+{
+    std::string line;
+    Request request;
+    std::shared_ptr<std::atomic<bool>> cancelled;
+    std::string error; // Why the line couldn't be parsed, if it couldn't
+};
+
+Request parseRequest(const std::string& line);
+
+// Whether the line is a :cancel, even one that can't be parsed
+bool isCancellation(const std::string& line);
+
+// Outputs the answer to a request that couldn't be handled, "error <message>" (the message on one line), in place of the request's usual output,
+// or of the rest of it once a search has streamed results (see handleQuery)
+void printError(const std::string& message);
+
+/*
+    Requests are read by a separate thread, so that a cancellation can take effect while a query is being handled.
+    Any request may be given an id option, and
+        :cancel[\t<id>]
+    cancels all outstanding (queued or running) requests with that id, or all outstanding requests if no id is given.
+    A cancelled query still gets its (truncated) output.
+*/
+class RequestQueue
+{
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<QueuedRequest> requests;
+    bool closed{false};
+
+    // Cancellation flags of outstanding requests by id, only accessed by the reader thread
+    std::unordered_multimap<std::string, std::weak_ptr<std::atomic<bool>>> cancellations;
+
+    void cancel(const std::string& id);
+
+    // Forget the flags of requests that have been handled
+    void prune();
+
+    void push(QueuedRequest request);
+
+    void close();
+
+public:
+    void read(std::istream& in);
+
+    // Blocks until there's a request, returns nothing once input has ended and all requests have been popped
+    std::optional<QueuedRequest> pop();
+};
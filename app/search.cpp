@@ -0,0 +1,484 @@
+#include "search.h"
+#include "k-mismatches/naive.h"
+#include "k-mismatches/utility/histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+using namespace std::literals;
+
+EpisodePattern::EpisodePattern(const std::string& pattern)
+    : pattern(pattern)
+{
+    const auto malformed([&](const std::string& what){ return std::runtime_error("Invalid episode pattern '"s + pattern + "': "s + what); });
+
+    // The character at pattern[i], or the one it escapes, moving i past it
+    const auto character([&](std::size_t& i)
+    {
+        if (pattern[i] == '\\' && ++i == std::size(pattern))
+            throw malformed("\\ at the end"s);
+
+        return (unsigned char)pattern[i++];
+    });
+
+    for (std::size_t i = 0; i < std::size(pattern);)
+    {
+        // Consecutive stars are one
+        if (pattern[i] == '*')
+        {
+            if (elements.empty() || !elements.back().star)
+                elements.push_back({true, {}});
+
+            ++i;
+            continue;
+        }
+
+        Element element{false, {}};
+        if (pattern[i] == '?')
+        {
+            element.characters.set();
+            ++i;
+        }
+        else if (pattern[i] == '[')
+        {
+            const bool negated(i + 1 < std::size(pattern) && pattern[i + 1] == '!');
+            i += negated ? 2 : 1;
+
+            // A ] first in the brackets is one of the characters
+            for (bool first = true; i == std::size(pattern) || pattern[i] != ']' || first; first = false)
+            {
+                if (i == std::size(pattern))
+                    throw malformed("[ without a ]"s);
+
+                const unsigned char low(character(i));
+                unsigned char high(low);
+                if (i + 1 < std::size(pattern) && pattern[i] == '-' && pattern[i + 1] != ']')
+                    high = character(++i);
+
+                for (unsigned c = low; c <= high; ++c)
+                    element.characters.set(c);
+            }
+
+            ++i;
+            if (negated)
+                element.characters.flip();
+        }
+        else
+            element.characters.set(character(i));
+
+        elements.push_back(element);
+    }
+}
+
+bool EpisodePattern::matches(const episodeName_t& name) const
+{
+    // Each star matches as few characters as it can, having matched one more on each retry, and only the last star passed is retried,
+    // as whatever more an earlier star could match, the last could match instead
+    std::size_t i_element(0), i(0), i_star(std::string::npos), i_starMatch(0);
+    while (i < std::size(name))
+        if (i_element < std::size(elements) && elements[i_element].star)
+        {
+            i_star = i_element++;
+            i_starMatch = i;
+        }
+        else if (i_element < std::size(elements) && elements[i_element].characters[(unsigned char)name[i]])
+        {
+            ++i_element;
+            ++i;
+        }
+        else if (i_star != std::string::npos)
+        {
+            i_element = i_star + 1;
+            i = ++i_starMatch;
+        }
+        else
+            return false;
+
+    return i_element == std::size(elements) || (i_element + 1 == std::size(elements) && elements[i_element].star);
+}
+
+bool parseFlag(const std::string& value)
+{
+    if (value == "1"s || value == "true"s)
+        return true;
+
+    if (value == "0"s || value == "false"s)
+        return false;
+
+    throw std::runtime_error("Invalid flag value '"s + value + "'"s);
+}
+
+unsigned long parseNumber(const std::string& value, unsigned long max)
+{
+    // stoul would take leading whitespace and a sign, negating the number, and ignore anything after it
+    if (value.empty() || !std::all_of(std::cbegin(value), std::cend(value), [](char c){ return c >= '0' && c <= '9'; }))
+        throw std::invalid_argument("parseNumber"s);
+
+    const unsigned long number(std::stoul(value));
+    if (number > max)
+        throw std::out_of_range("parseNumber"s);
+
+    return number;
+}
+
+float parseFraction(const std::string& value)
+{
+    std::size_t n_parsed;
+    const float number(std::stof(value, &n_parsed));
+    if (n_parsed != std::size(value) || !std::isfinite(number))
+        throw std::invalid_argument("parseFraction"s);
+
+    return std::clamp(number, 0.f, 1.f);
+}
+
+void setSearchOption(SearchOptions& options, const std::string& name, const std::string& value)
+try
+{
+    if (name == "episode-text"s)
+        options.episodeText = parseFlag(value);
+    else if (name == "words"s)
+        options.words = parseFlag(value);
+    else if (name == "stream"s)
+        options.stream = parseFlag(value);
+    else if (name == "budget"s)
+        options.budget = parseNumber(value, maxBudgetOption) * 1ms;
+    else if (name == "mismatch-ratio"s)
+        options.mismatchRatio = parseFraction(value);
+    else if (name == "max-mismatches"s)
+        options.maxMismatches = unsigned(parseNumber(value, maxMismatchesOption));
+    else if (name == "min-similarity"s)
+        options.minSimilarity = parseFraction(value);
+    else if (name == "scoring"s)
+    {
+        if (value == "absolute"s)
+            options.scoring = Scoring::absolute;
+        else if (value == "relative"s)
+            options.scoring = Scoring::relative;
+        else
+            throw std::runtime_error("Unknown scoring '"s + value + "'"s);
+    }
+    else if (name == "episode"s)
+        options.episodes.push_back(value);
+    else if (name == "episode-pattern"s)
+        options.episodePattern.emplace(value);
+    else if (name == "from"s)
+        options.from = parseNumber(value, maxTimeOption) * 1ms;
+    else if (name == "to"s)
+        options.to = parseNumber(value, maxTimeOption) * 1ms;
+    else if (name == "session"s)
+        options.session = value;
+    else if (name == "verify"s)
+        options.verify = parseFlag(value);
+    else if (name == "limit"s)
+        options.limit = unsigned(parseNumber(value, maxLimitOption));
+    else
+        throw std::runtime_error("Unknown search option '"s + name + "'"s);
+}
+// The numbers' conversions throw these, with no more than the conversion's name to say
+catch (const std::logic_error&)
+{
+    throw std::runtime_error("Invalid value '"s + value + "' for search option '"s + name + "'"s);
+}
+
+float similarity(unsigned mismatches, unsigned m, const SearchOptions& options)
+{
+    if (options.scoring == Scoring::relative)
+        return 1 - float(mismatches) / std::max(m, 1u);
+
+    return 1 - float(mismatches) / float(double(options.maxMismatches) + 1);
+}
+
+unsigned mismatchBudget(unsigned m, const SearchOptions& options)
+{
+    const double scale(options.scoring == Scoring::relative ? std::max(m, 1u) : double(options.maxMismatches) + 1);
+    const unsigned k_similarity(unsigned(std::max((1 - options.minSimilarity) * scale + 1e-4, 0.)));
+    return std::min({unsigned(options.mismatchRatio * m), options.maxMismatches, k_similarity});
+}
+
+// Index of the subtitle of episode whose text (or following separator) contains episodeText(episode)[i]
+unsigned subtitleAt(const Episode& episode, unsigned i)
+{
+    return unsigned(std::upper_bound(std::cbegin(episode.subtitleBegins), std::cend(episode.subtitleBegins), i) - std::cbegin(episode.subtitleBegins) - 1);
+}
+
+bool isScoped(const SearchOptions& options)
+{
+    return !options.episodes.empty() || options.episodePattern;
+}
+
+std::vector<const Episode*> scopedEpisodes(const Corpus& corpus, const SearchOptions& options)
+{
+    std::vector<unsigned> indices;
+    if (options.episodes.empty())
+    {
+        indices.resize(std::size(corpus.episodes));
+        std::iota(std::begin(indices), std::end(indices), 0u);
+    }
+    else
+    {
+        for (const episodeName_t& name : options.episodes)
+        {
+            const auto [it_begin, it_end] = corpus.episodesByName.equal_range(name);
+            for (auto it(it_begin); it != it_end; ++it)
+                indices.push_back(it->second);
+        }
+
+        std::sort(std::begin(indices), std::end(indices));
+        indices.erase(std::unique(std::begin(indices), std::end(indices)), std::end(indices));
+    }
+
+    std::vector<const Episode*> episodes;
+    for (unsigned i : indices)
+        if (!options.episodePattern || options.episodePattern->matches(corpus.episodes[i]->name))
+            episodes.push_back(corpus.episodes[i]);
+
+    return episodes;
+}
+
+std::pair<unsigned, unsigned> scopedSubtitles(const Episode& episode, const SearchOptions& options)
+{
+    const auto it_begin(std::lower_bound(std::cbegin(episode.subtitles), std::cend(episode.subtitles), options.from, [](const SubtitleTimes& subtitle, std::chrono::milliseconds time){ return subtitle.time_begin < time; }));
+    const auto it_end(std::lower_bound(it_begin, std::cend(episode.subtitles), options.to, [](const SubtitleTimes& subtitle, std::chrono::milliseconds time){ return subtitle.time_begin < time; }));
+    return {unsigned(it_begin - std::cbegin(episode.subtitles)), unsigned(it_end - std::cbegin(episode.subtitles))};
+}
+
+// The range [first, second) of the episode's text of its subtitles [i_begin, i_end), given the size of the text
+std::pair<unsigned, unsigned> subtitlesTextRange(const Episode& episode, unsigned i_begin, unsigned i_end, unsigned n_text)
+{
+    if (i_begin == i_end)
+        return {0, 0};
+
+    return {episode.subtitleBegins[i_begin], i_end < std::size(episode.subtitles) ? episode.subtitleBegins[i_end] - unsigned(sizeof subtitleSeparator) : n_text};
+}
+
+std::vector<QueryResult> searchEpisodeText(const Episode& episode, const PreparedQuery& query, const SearchOptions& options, const Deadline& deadline)
+{
+    const unsigned m = unsigned(std::size(query.pattern()));
+    const std::string_view text(episodeText(episode));
+    const auto [i_begin, i_end] = scopedSubtitles(episode, options);
+    const auto [i_textBegin, i_textEnd] = subtitlesTextRange(episode, i_begin, i_end, unsigned(std::size(text)));
+    std::vector<Alignment> alignments(query.matchAll(text.substr(i_textBegin, i_textEnd - i_textBegin), mismatchBudget(m, options), true, &deadline));
+    for (Alignment& alignment : alignments)
+        alignment.i += i_textBegin;
+
+    // Each subtitle is reported at most once, by the best alignment covering it
+    std::stable_sort(std::begin(alignments), std::end(alignments), [](const Alignment& lhs, const Alignment& rhs){ return lhs.mismatches < rhs.mismatches; });
+    std::vector<bool> covered(std::size(episode.subtitles));
+    std::vector<QueryResult> results;
+    for (Alignment& alignment : alignments)
+    {
+        const unsigned
+            i_first = subtitleAt(episode, alignment.i),
+            i_last = subtitleAt(episode, alignment.i + std::max(m, 1u) - 1);
+
+        if (std::any_of(std::cbegin(covered) + i_first, std::cbegin(covered) + i_last + 1, [](bool b){ return b; }))
+            continue;
+
+        std::fill(std::begin(covered) + i_first, std::begin(covered) + i_last + 1, true);
+        results.push_back({alignment.mismatches, episode.name, copySubtitles(episode, i_first, i_last), alignment.i - episode.subtitleBegins[i_first], std::move(alignment.positions)});
+    }
+
+    return results;
+}
+
+std::vector<QueryResult> searchEpisode(const Episode& episode, const PreparedQuery& query, const SearchOptions& options, const Deadline& deadline)
+{
+    if (options.episodeText)
+        return searchEpisodeText(episode, query, options, deadline);
+
+    const unsigned
+        m = unsigned(std::size(query.pattern())),
+        k = mismatchBudget(m, options);
+
+    std::vector<QueryResult> results;
+    const auto [i_begin, i_end] = scopedSubtitles(episode, options);
+    for (unsigned i_subtitle = i_begin; i_subtitle < i_end; ++i_subtitle)
+    {
+        // Rule out subtitles that are too short or don't have enough of the query's characters without building anything
+        // (the histograms first, if they haven't been dropped, as getting the text of a compressed subtitle decompresses it)
+        if (std::size(episode.histograms) != 0 && maxMatches(query.histogram(), episode.histograms[i_subtitle]) + k < m)
+            continue;
+
+        const std::string_view text(subtitleText(episode, i_subtitle));
+        if (std::size(text) < m)
+            continue;
+
+        if (deadline.expired())
+            break;
+
+        if (Alignment best; const Mismatches minMismatches = query.match(text, k, &best, &deadline))
+            results.push_back({minMismatches, episode.name, copySubtitles(episode, i_subtitle, i_subtitle), best.i, std::move(best.positions)});
+    }
+
+    return results;
+}
+
+std::vector<QueryResult> searchExact(const std::vector<const Episode*>& episodes, const std::string& query, const SearchOptions& options, unsigned limit, const Deadline& deadline)
+{
+    const unsigned m = unsigned(std::size(query));
+    const std::boyer_moore_horspool_searcher searcher(std::cbegin(query), std::cend(query));
+    std::vector<QueryResult> results;
+    for (const Episode* p_episode : episodes)
+    {
+        if (std::size(results) >= limit || deadline.expired())
+            break;
+
+        const Episode& episode(*p_episode);
+        const std::string_view text(episodeText(episode));
+        const auto [i_begin, i_end] = scopedSubtitles(episode, options);
+        const auto [i_textBegin, i_textEnd] = subtitlesTextRange(episode, i_begin, i_end, unsigned(std::size(text)));
+        const auto it_text(std::cbegin(text)), it_end(it_text + i_textEnd);
+        for (auto it(it_text + i_textBegin); std::size(results) < limit;)
+        {
+            it = std::search(it, it_end, searcher);
+            if (it == it_end)
+                break;
+
+            const unsigned
+                i = unsigned(it - it_text),
+                i_first = subtitleAt(episode, i),
+                i_last = subtitleAt(episode, i + m - 1),
+                i_firstBegin = episode.subtitleBegins[i_first];
+
+            // Unless searching the episode as a whole, the match has to be within a subtitle
+            if (!options.episodeText && (i_last != i_first || i + m > i_firstBegin + std::size(subtitleText(episode, i_first))))
+            {
+                ++it;
+                continue;
+            }
+
+            results.push_back({0, episode.name, copySubtitles(episode, i_first, i_last), i - i_firstBegin, {}});
+
+            // Each subtitle is reported at most once, by the first match covering it
+            if (i_last + 1 == i_end)
+                break;
+
+            it = it_text + episode.subtitleBegins[i_last + 1];
+        }
+    }
+
+    return results;
+}
+
+void sortResults(std::vector<QueryResult>& results)
+{
+    std::stable_sort(std::begin(results), std::end(results), [](const QueryResult& lhs, const QueryResult& rhs){ return std::tie(lhs.mismatches, lhs.episodeName) < std::tie(rhs.mismatches, rhs.episodeName); });
+}
+
+std::vector<QueryResult> searchEpisodes(const std::vector<const Episode*>& episodes, const PreparedQuery& query, const SearchOptions& options, const Deadline& deadline, const std::function<void(std::vector<QueryResult>&)>& onEpisodeResults)
+{
+    std::vector<QueryResult> results;
+    for (const Episode* episode : episodes)
+    {
+        if (deadline.expired())
+            break;
+
+        if (std::vector<QueryResult> result(searchEpisode(*episode, query, options, deadline)); !result.empty())
+        {
+            if (onEpisodeResults)
+                onEpisodeResults(result);
+
+            results.insert(std::end(results), std::make_move_iterator(std::begin(result)), std::make_move_iterator(std::end(result)));
+        }
+    }
+
+    return results;
+}
+
+// The results of searching the episodes with the reference matcher, which compares the query with every alignment in every subtitle (or episode's text)
+// without ruling any out first, sorted and limited as handleQuery outputs them
+std::vector<QueryResult> referenceSearch(const std::vector<const Episode*>& episodes, const std::string& query, const SearchOptions& options)
+{
+    const NaiveQuery reference(query);
+    const unsigned
+        m = unsigned(std::size(query)),
+        k = mismatchBudget(m, options);
+
+    std::vector<QueryResult> results;
+    for (const Episode* p_episode : episodes)
+    {
+        const Episode& episode(*p_episode);
+        if (options.episodeText)
+        {
+            std::vector<QueryResult> result(searchEpisodeText(episode, reference, options, Deadline()));
+            results.insert(std::end(results), std::make_move_iterator(std::begin(result)), std::make_move_iterator(std::end(result)));
+            continue;
+        }
+
+        const auto [i_begin, i_end] = scopedSubtitles(episode, options);
+        for (unsigned i_subtitle = i_begin; i_subtitle < i_end; ++i_subtitle)
+            if (Alignment best; const Mismatches minMismatches = reference.match(subtitleText(episode, i_subtitle), k, &best))
+                results.push_back({minMismatches, episode.name, copySubtitles(episode, i_subtitle, i_subtitle), best.i, std::move(best.positions)});
+    }
+
+    sortResults(results);
+    if (options.limit != 0 && std::size(results) > options.limit)
+        results.resize(options.limit);
+
+    return results;
+}
+
+std::string describeResult(const std::vector<QueryResult>& results, unsigned i)
+{
+    if (i >= std::size(results))
+        return "nothing"s;
+
+    const QueryResult& result(results[i]);
+    std::ostringstream description;
+    description
+        << "episode '"s << result.episodeName << "' subtitle at "s << result.subtitles.front().time_begin.count() << " ms, "s
+        << result.mismatches << " mismatches from offset "s << result.offset << " at ["s;
+
+    for (unsigned j = 0; j < std::size(result.mismatchPositions); ++j)
+        description << (j != 0 ? ", "s : ""s) << result.mismatchPositions[j];
+
+    description << ']';
+    return description.str();
+}
+
+void verifyResults(const std::vector<const Episode*>& episodes, const std::string& query, const SearchOptions& options, const std::vector<QueryResult>& results)
+{
+    const std::vector<QueryResult> expected(referenceSearch(episodes, query, options));
+    const auto same([](const QueryResult& lhs, const QueryResult& rhs)
+    {
+        return
+            lhs.mismatches == rhs.mismatches && lhs.episodeName == rhs.episodeName && lhs.offset == rhs.offset && lhs.mismatchPositions == rhs.mismatchPositions
+            && std::size(lhs.subtitles) == std::size(rhs.subtitles) && lhs.subtitles.front().time_begin == rhs.subtitles.front().time_begin;
+    });
+
+    for (unsigned i = 0; i < std::max(std::size(results), std::size(expected)); ++i)
+        if (i == std::size(results) || i == std::size(expected) || !same(results[i], expected[i]))
+        {
+            std::clog
+                << "Warning: verification failed for query '"s << query << "', result "s << i << " is "s << describeResult(results, i)
+                << ", the reference matcher's is "s << describeResult(expected, i) << '\n';
+
+            return;
+        }
+}
+
+void printResults(const std::vector<QueryResult>& results, unsigned m, const SearchOptions& options)
+{
+    for (const QueryResult& result : results)
+    {
+        std::cout
+            << similarity(result.mismatches, m, options) << '\n'
+            << result.episodeName << '\n'
+            << result.offset;
+
+        for (unsigned position : result.mismatchPositions)
+            std::cout << ' ' << position;
+
+        std::cout << '\n';
+        for (const Subtitle& subtitle : result.subtitles)
+            std::cout << subtitle.time_begin.count() << ", " << subtitle.time_end.count() << ", " << subtitle.text << '\n';
+
+        std::cout << '\n';
+    }
+}
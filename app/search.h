@@ -0,0 +1,144 @@
+#pragma once
+#include "corpus.h"
+#include "k-mismatches/kangaroo.h"
+
+#include <bitset>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct QueryResult
+{
+    unsigned mismatches;
+    episodeName_t episodeName;
+    std::vector<Subtitle> subtitles;         // The consecutive subtitles covered by the match
+    unsigned offset;                         // Index into the first subtitle's text where the match begins
+    std::vector<unsigned> mismatchPositions; // Indices into the query of the mismatched characters
+};
+
+enum class Scoring
+{
+    absolute, // 1 - mismatches / (maxMismatches + 1)
+    relative  // 1 - mismatches / query length
+};
+
+/*
+    A pattern that whole episode names match, in which * matches any characters, ? any one character, [...] any one of the characters in it
+    (with ranges such as [a-z], or any but them if it begins with !), and \ makes the character after it match itself. Characters are bytes.
+    Being a glob rather than a regex, it can't make matching a name take more than O(name length * pattern length).
+*/
+class EpisodePattern
+{
+    // The characters that the next character of a name may be, or any characters, if star
+    struct Element
+    {
+        bool star;
+        std::bitset<256> characters;
+    };
+
+    std::string pattern;
+    std::vector<Element> elements;
+
+public:
+    // Throws if the pattern is malformed, with a [ that isn't closed or a \ that escapes nothing
+    explicit EpisodePattern(const std::string& pattern);
+
+    bool matches(const episodeName_t& name) const;
+
+    bool operator==(const EpisodePattern& other) const { return pattern == other.pattern; }
+};
+
+struct SearchOptions
+{
+    // Search each episode's text as a whole, so that quotes spanning consecutive subtitles are found
+    bool episodeText{false};
+
+    // Search by word through the word index, counting mismatched words rather than characters, see searchWords
+    bool words{false};
+
+    // Output each episode's results as soon as it has been searched, before the sorted results of the whole search
+    bool stream{false};
+
+    // Time after which the search is abandoned and the results so far are output, flagged as truncated (0 for no limit)
+    std::chrono::milliseconds budget{0};
+
+    // The number of mismatches allowed is the least of mismatchRatio * query length, maxMismatches,
+    // and the most that still scores a similarity of at least minSimilarity
+    float mismatchRatio{0.25f};
+    unsigned maxMismatches{16};
+    float minSimilarity{0};
+    Scoring scoring{Scoring::absolute};
+
+    // The scope of the search: the episodes named (all, if none are) whose names match episodePattern (if given),
+    // and of those, the subtitles beginning in the time window [from, to)
+    std::vector<episodeName_t> episodes;
+    std::optional<EpisodePattern> episodePattern;
+    std::chrono::milliseconds from{0}, to{std::chrono::milliseconds::max()};
+
+    // Queries of the same session reuse the work of the session's last query when they extend it, see Session
+    std::string session;
+
+    // Check the results of each complete search against a search with the reference matcher, warning of the first that differs, see verifyResults
+    // It's O(nm) per subtitle, for trying the fast backends on real queries rather than for serving them
+    bool verify{false};
+
+    // Maximum number of results output (0 for no limit)
+    // If there are at least this many exact matches, they're found by a plain substring search without doing the k-mismatch search
+    unsigned limit{0};
+};
+
+// The most that the numeric options may be set to, so that nothing computed from them overflows
+const static unsigned long
+    maxBudgetOption = 3600000, // An hour
+    maxMismatchesOption = 1 << 16,
+    maxTimeOption = 0xffffffff, // About 49 days
+    maxLimitOption = 1 << 20;
+
+bool parseFlag(const std::string& value);
+
+// A whole number from 0 to max, written in decimal digits only
+// Throws std::invalid_argument or std::out_of_range, as the conversions do, if value isn't one
+unsigned long parseNumber(const std::string& value, unsigned long max);
+
+// A number clamped to [0, 1]
+// Throws std::invalid_argument or std::out_of_range, as the conversions do, if value isn't a finite number
+float parseFraction(const std::string& value);
+
+void setSearchOption(SearchOptions& options, const std::string& name, const std::string& value);
+
+float similarity(unsigned mismatches, unsigned m, const SearchOptions& options);
+
+unsigned mismatchBudget(unsigned m, const SearchOptions& options);
+
+bool isScoped(const SearchOptions& options);
+
+// The episodes in the scope of options, in corpus order, looked up by name if they're named
+std::vector<const Episode*> scopedEpisodes(const Corpus& corpus, const SearchOptions& options);
+
+// The range [first, second) of the episode's subtitles that begin in the time window of options
+std::pair<unsigned, unsigned> scopedSubtitles(const Episode& episode, const SearchOptions& options);
+
+/*
+    The exact matches of the (non-empty) query in corpus order, stopping once there are limit of them.
+    These are the same results, in the same order, as the k-mismatch search gives with no mismatches.
+    The search stops early if deadline expires, in which case deadline.stopped() is true.
+*/
+std::vector<QueryResult> searchExact(const std::vector<const Episode*>& episodes, const std::string& query, const SearchOptions& options, unsigned limit, const Deadline& deadline);
+
+/*
+    Best first, and of those that score the same, by episode name, and then in the order found, which for an episode is the order in its text.
+    This doesn't depend on how the corpus is sharded, so the coordinator can merge the shards' results in the same order, see Coordinator.
+*/
+void sortResults(std::vector<QueryResult>& results);
+
+// onEpisodeResults is called with the (unsorted) results of each episode that has any, as soon as that episode has been searched
+// The search stops early if deadline expires, in which case the results are incomplete and deadline.stopped() is true
+std::vector<QueryResult> searchEpisodes(const std::vector<const Episode*>& episodes, const PreparedQuery& query, const SearchOptions& options, const Deadline& deadline, const std::function<void(std::vector<QueryResult>&)>& onEpisodeResults = nullptr);
+
+// Warns of the first of the results of a complete search that differs from the reference search's, naming the query and subtitle
+void verifyResults(const std::vector<const Episode*>& episodes, const std::string& query, const SearchOptions& options, const std::vector<QueryResult>& results);
+
+void printResults(const std::vector<QueryResult>& results, unsigned m, const SearchOptions& options);
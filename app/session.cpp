@@ -0,0 +1,168 @@
+#include "session.h"
+#include "memoryUsage.h"
+#include "k-mismatches/utility/histogram.h"
+
+#include <algorithm>
+
+unsigned Session::candidateBudget(std::string_view text, unsigned i) const
+{
+    return mismatchBudget(std::min(m_max, unsigned(std::size(text)) - i), options);
+}
+
+bool Session::sameSearch(const SearchOptions& lhs, const SearchOptions& rhs)
+{
+    return
+        lhs.mismatchRatio == rhs.mismatchRatio && lhs.maxMismatches == rhs.maxMismatches && lhs.minSimilarity == rhs.minSimilarity && lhs.scoring == rhs.scoring
+        && lhs.episodes == rhs.episodes && lhs.episodePattern == rhs.episodePattern && lhs.from == rhs.from && lhs.to == rhs.to;
+}
+
+void Session::findCandidates(const std::vector<const Episode*>& episodes, const PreparedQuery& query, const SearchOptions& options, const Deadline& deadline)
+{
+    const unsigned m = unsigned(std::size(query.pattern()));
+    m_max = std::max(horizon * m, 1u);
+    ++n_fullSearches;
+
+    candidates.clear();
+    for (const Episode* episode : episodes)
+    {
+        if (deadline.expired())
+            break;
+
+        const auto [i_begin, i_end] = scopedSubtitles(*episode, options);
+        for (unsigned i_subtitle = i_begin; i_subtitle < i_end; ++i_subtitle)
+        {
+            const std::string_view text(subtitleText(*episode, i_subtitle));
+            if (std::size(text) < m)
+                continue;
+
+            // No query covered is longer than the text, so none is allowed more mismatches than one as long as the text
+            const unsigned k = candidateBudget(text, 0);
+            if (std::size(episode->histograms) != 0 && maxMatches(query.histogram(), episode->histograms[i_subtitle]) + k < m)
+                continue;
+
+            for (const Alignment& alignment : query.matchAll(text, k, false, &deadline))
+                if (alignment.mismatches <= candidateBudget(text, alignment.i))
+                    candidates.push_back({episode, i_subtitle, alignment.i, alignment.mismatches});
+        }
+    }
+}
+
+void Session::extendCandidates(std::string_view extension, const Deadline& deadline)
+{
+    const unsigned m = unsigned(std::size(query));
+    std::vector<Candidate> extended;
+    for (const Candidate& candidate : candidates)
+    {
+        if (deadline.expired())
+            break;
+
+        const std::string_view text(subtitleText(*candidate.episode, candidate.i_subtitle));
+        if (candidate.i + m + std::size(extension) > std::size(text))
+            continue;
+
+        const unsigned k = candidateBudget(text, candidate.i);
+        unsigned mismatches = candidate.mismatches;
+        for (unsigned j = 0; j < std::size(extension) && mismatches <= k; ++j)
+            mismatches += text[candidate.i + m + j] != extension[j];
+
+        if (mismatches <= k)
+            extended.push_back({candidate.episode, candidate.i_subtitle, candidate.i, mismatches});
+    }
+
+    candidates = std::move(extended);
+}
+
+std::vector<QueryResult> Session::results(unsigned k) const
+{
+    std::vector<QueryResult> results;
+    for (auto it(std::cbegin(candidates)); it != std::cend(candidates);)
+    {
+        auto it_best(it);
+        for (; it != std::cend(candidates) && it->episode == it_best->episode && it->i_subtitle == it_best->i_subtitle; ++it)
+            if (it->mismatches < it_best->mismatches)
+                it_best = it;
+
+        if (it_best->mismatches > k)
+            continue;
+
+        const Candidate& best(*it_best);
+        const std::string_view text(subtitleText(*best.episode, best.i_subtitle));
+        std::vector<unsigned> positions;
+        for (unsigned j = 0; j < std::size(query); ++j)
+            if (text[best.i + j] != query[j])
+                positions.push_back(j);
+
+        results.push_back({best.mismatches, best.episode->name, copySubtitles(*best.episode, best.i_subtitle, best.i_subtitle), best.i, std::move(positions)});
+    }
+
+    return results;
+}
+
+std::size_t Session::memory() const
+{
+    return sizeof(Session) + stringMemory(query) + vectorMemory(candidates);
+}
+
+void Session::setCorpus(const std::shared_ptr<const Corpus>& current)
+{
+    if (corpus.lock() != current)
+    {
+        corpus = current;
+        valid = false;
+    }
+}
+
+std::vector<QueryResult> Session::search(const std::vector<const Episode*>& episodes, const PreparedQuery& query, const SearchOptions& options, const Deadline& deadline)
+{
+    const std::string& P(query.pattern());
+    if (valid && sameSearch(options, this->options) && std::size(P) <= m_max && P.compare(0, std::size(this->query), this->query) == 0)
+    {
+        extendCandidates(std::string_view(P).substr(std::size(this->query)), deadline);
+        this->query = P;
+    }
+    else
+    {
+        this->query = P;
+        this->options = options;
+        findCandidates(episodes, query, options, deadline);
+    }
+
+    valid = !deadline.stopped() && std::size(candidates) <= maxCandidates;
+    std::vector<QueryResult> results(this->results(mismatchBudget(unsigned(std::size(P)), options)));
+    if (!valid)
+        candidates = std::vector<Candidate>();
+
+    return results;
+}
+
+Session& Sessions::get(const std::string& name, const std::shared_ptr<const Corpus>& corpus)
+{
+    auto it(std::find_if(std::begin(sessions), std::end(sessions), [&](const std::pair<std::string, Session>& session){ return session.first == name; }));
+    if (it == std::end(sessions))
+    {
+        sessions.emplace_front(name, Session());
+        if (std::size(sessions) > maxSessions)
+            sessions.pop_back();
+    }
+    else
+        sessions.splice(std::begin(sessions), sessions, it);
+
+    Session& session(sessions.front().second);
+    session.setCorpus(corpus);
+    return session;
+}
+
+std::size_t Sessions::memory() const
+{
+    std::size_t bytes(0);
+    for (const auto& [name, session] : sessions)
+        bytes += nodeMemory + stringMemory(name) + session.memory();
+
+    return bytes;
+}
+
+void Sessions::fit(std::size_t bytes)
+{
+    while (!sessions.empty() && memory() > bytes)
+        sessions.pop_back();
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "corpus.h"
+#include "search.h"
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// An alignment of a query with a subtitle
+struct Candidate
+{
+    const Episode* episode;
+    unsigned i_subtitle;
+    unsigned i; // Index into the subtitle's text
+    unsigned mismatches;
+};
+
+/*
+    The queries of a session, typically one user typing, often each extend the last. Given the alignments of the last query with as many mismatches
+    as a query extending it could be allowed (its candidates), the alignments of the query extending it are among them, so only they need to be extended.
+    Otherwise the episodes are searched in full, the same as without a session, finding the candidates for the next query.
+    The mismatches a query is allowed grow with its length, so the candidates only cover queries up to horizon times as long as the one they're found for,
+    and of those, only as long as fits in the text after each alignment. A query longer than that searches in full, covering queries longer still.
+    The candidates are kept only if the search they come from was complete and of the same version of the corpus and search options,
+    and if there aren't too many of them to be worth keeping.
+*/
+class Session
+{
+    static constexpr std::size_t maxCandidates = 1 << 20;
+    static constexpr unsigned horizon = 2;
+
+    std::weak_ptr<const Corpus> corpus;
+    std::string query;
+    SearchOptions options;
+    std::vector<Candidate> candidates;
+    unsigned m_max{0}; // The length of the longest query the candidates cover
+    bool valid{false};
+    unsigned n_fullSearches{0};
+
+    // The most mismatches an alignment at text[i] can have and still extend to one that a query the candidates cover is allowed
+    unsigned candidateBudget(std::string_view text, unsigned i) const;
+
+    // Whether the options give the same alignments of the same query
+    static bool sameSearch(const SearchOptions& lhs, const SearchOptions& rhs);
+
+    void findCandidates(const std::vector<const Episode*>& episodes, const PreparedQuery& query, const SearchOptions& options, const Deadline& deadline);
+
+    // The candidates of the query, which extends the last one by extension
+    void extendCandidates(std::string_view extension, const Deadline& deadline);
+
+    // Each subtitle's first alignment with the fewest mismatches, if they're at most k, as searchEpisode finds them
+    std::vector<QueryResult> results(unsigned k) const;
+
+public:
+    std::size_t memory() const;
+
+    // Whether the candidates were kept for the next query
+    bool reusable() const
+    {
+        return valid;
+    }
+
+    // The number of queries for which the episodes were searched in full
+    unsigned fullSearches() const
+    {
+        return n_fullSearches;
+    }
+
+    // Forgets the candidates unless they're of this version of the corpus
+    void setCorpus(const std::shared_ptr<const Corpus>& current);
+
+    // The results of searching the episodes, as searchEpisodes gives them without episode-text, incomplete if deadline.stopped() is true
+    // The candidates are only kept if the search didn't stop early
+    std::vector<QueryResult> search(const std::vector<const Episode*>& episodes, const PreparedQuery& query, const SearchOptions& options, const Deadline& deadline);
+};
+
+// The sessions of the queries handled, the least recently used being forgotten
+class Sessions
+{
+    static constexpr std::size_t maxSessions = 64;
+
+    std::list<std::pair<std::string, Session>> sessions; // Most recently used first
+
+public:
+    // The most the sessions keep, whatever the memory budget, as each may keep up to Session::maxCandidates
+    static constexpr std::size_t maxMemory = std::size_t(64) << 20;
+
+    Session& get(const std::string& name, const std::shared_ptr<const Corpus>& corpus);
+
+    std::size_t memory() const;
+
+    // Forgets the least recently used sessions until the rest take at most bytes
+    void fit(std::size_t bytes);
+};
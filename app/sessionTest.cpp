@@ -0,0 +1,127 @@
+#include "corpus.h"
+#include "search.h"
+#include "session.h"
+#include "k-mismatches/kangaroo.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <experimental/filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std::literals;
+
+/*
+    Checks sessions against searching afresh. Each case types a query into a new session one character at a time, the query being a subtitle of the corpus
+    with a few characters changed. Each query's results have to be those of searching for it afresh, and the session has to stay reusable throughout,
+    searching in full for fewer queries than it's given and taking less time than searching afresh for them all.
+    The corpus is generated from a small vocabulary, so that the queries have many near matches.
+*/
+
+const std::vector<std::string> vocabulary{"the"s, "krusty"s, "krab"s, "is"s, "this"s, "no"s, "patrick"s, "unfair"s, "pizza"s, "delivery"s, "squidward"s, "spongebob"s, "jellyfish"s, "bikini"s, "bottom"s, "formula"s};
+
+std::string formatTimestamp(unsigned milliseconds)
+{
+    const auto twoDigits([](unsigned n){ return (n < 10 ? "0"s : ""s) + std::to_string(n); });
+    return std::to_string(milliseconds / 3600000) + ':' + twoDigits(milliseconds / 60000 % 60) + ':' + twoDigits(milliseconds / 1000 % 60) + '.' + std::to_string(1000 + milliseconds % 1000).substr(1);
+}
+
+std::string describeResult(const QueryResult& result)
+{
+    std::string description(std::to_string(result.mismatches) + " mismatches in '"s + result.episodeName + "' at "s + std::to_string(result.offset) + " of '"s + result.subtitles.front().text + "'"s);
+    return description;
+}
+
+bool sameResult(const QueryResult& lhs, const QueryResult& rhs)
+{
+    return lhs.mismatches == rhs.mismatches && lhs.episodeName == rhs.episodeName && lhs.offset == rhs.offset && lhs.mismatchPositions == rhs.mismatchPositions
+        && lhs.subtitles.front().time_begin == rhs.subtitles.front().time_begin && lhs.subtitles.front().text == rhs.subtitles.front().text;
+}
+
+int main(int argc, char* argv[])
+{
+    const std::vector<std::string> args(argv, argv + argc);
+    if (std::size(args) > 3)
+        return std::cerr << args[0] << " [<cases> [<seed>]]\n"s, EXIT_FAILURE;
+
+    const unsigned long
+        n_cases = std::size(args) > 1 ? std::stoul(args[1]) : 4,
+        seed = std::size(args) > 2 ? std::stoul(args[2]) : std::random_device()();
+
+    std::mt19937 random(seed);
+    const auto uniform([&](unsigned n){ return std::uniform_int_distribution<unsigned>(0, n - 1)(random); });
+
+    // A subtitles file per episode
+    const std::experimental::filesystem::path directory(std::experimental::filesystem::temp_directory_path() / ("karen-session-test-"s + std::to_string(seed)));
+    std::experimental::filesystem::create_directories(directory / "subtitles"s);
+    {
+        std::ofstream offsets(directory / "offsets.txt"s);
+        for (unsigned i_episode = 0; i_episode < 100; ++i_episode)
+        {
+            const std::string name("Episode "s + std::to_string(i_episode));
+            offsets << name << ": 0\n"s;
+            std::ofstream subtitles(directory / "subtitles"s / (name + ".txt"s));
+            for (unsigned i_subtitle = 0; i_subtitle < 400; ++i_subtitle)
+            {
+                subtitles << formatTimestamp(1000 * i_subtitle) << ", "s << formatTimestamp(1000 * i_subtitle + 900) << ", "s << vocabulary[uniform(unsigned(std::size(vocabulary)))];
+                for (unsigned n_words = uniform(8); n_words != 0; --n_words)
+                    subtitles << ' ' << vocabulary[uniform(unsigned(std::size(vocabulary)))];
+
+                subtitles << '\n';
+            }
+        }
+    }
+
+    const std::shared_ptr<const Corpus> corpus(std::make_shared<Corpus>(loadCorpus(directory / "subtitles"s, directory / "offsets.txt"s, Shard(), false, false)));
+    std::experimental::filesystem::remove_all(directory);
+
+    const SearchOptions options;
+    std::chrono::steady_clock::duration sessionTime{0}, freshTime{0};
+    for (unsigned long i_case = 0; i_case < n_cases; ++i_case)
+    {
+        const Episode& episode(*corpus->episodes[uniform(unsigned(std::size(corpus->episodes)))]);
+        std::string P(subtitleText(episode, uniform(std::size(episode.subtitles))));
+        for (unsigned n_mutations = uniform(3); n_mutations != 0; --n_mutations)
+            P[uniform(unsigned(std::size(P)))] = char('a' + uniform(26));
+
+        Session session;
+        session.setCorpus(corpus);
+        for (unsigned m = 1; m <= std::size(P); ++m)
+        {
+            const std::string query(P.substr(0, m));
+            const KangarooQuery preparedQuery(query, corpus->alphabet);
+
+            const auto time_session(std::chrono::steady_clock::now());
+            std::vector<QueryResult> sessionResults(session.search(corpus->episodes, preparedQuery, options, Deadline()));
+            const auto time_fresh(std::chrono::steady_clock::now());
+            std::vector<QueryResult> freshResults(searchEpisodes(corpus->episodes, preparedQuery, options, Deadline()));
+            sessionTime += time_fresh - time_session;
+            freshTime += std::chrono::steady_clock::now() - time_fresh;
+
+            sortResults(sessionResults);
+            sortResults(freshResults);
+            for (unsigned i = 0; i < std::max(std::size(sessionResults), std::size(freshResults)); ++i)
+                if (i == std::size(sessionResults) || i == std::size(freshResults) || !sameResult(sessionResults[i], freshResults[i]))
+                    return std::cout
+                        << "Case "s << i_case << " of seed "s << seed << ": the session's result "s << i << " for '"s << query << "' is "s
+                        << (i < std::size(sessionResults) ? describeResult(sessionResults[i]) : "missing"s) << ", searching afresh it's "s
+                        << (i < std::size(freshResults) ? describeResult(freshResults[i]) : "missing"s) << '\n', EXIT_FAILURE;
+
+            if (!session.reusable())
+                return std::cout << "Case "s << i_case << " of seed "s << seed << ": the session isn't reusable after '"s << query << "'\n"s, EXIT_FAILURE;
+        }
+
+        if (session.fullSearches() >= std::size(P))
+            return std::cout << "Case "s << i_case << " of seed "s << seed << ": the session searched in full for each of the "s << std::size(P) << " queries of '"s << P << "'\n"s, EXIT_FAILURE;
+    }
+
+    const auto milliseconds([](std::chrono::steady_clock::duration duration){ return std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(duration).count()) + " ms"s; });
+    std::cout << "Sessions took "s << milliseconds(sessionTime) << ", searching afresh "s << milliseconds(freshTime) << '\n';
+    if (sessionTime >= freshTime)
+        return std::cout << "Sessions of seed "s << seed << " took no less time than searching afresh\n"s, EXIT_FAILURE;
+
+    std::cout << n_cases << " cases of seed "s << seed << " passed\n"s;
+}
@@ -0,0 +1,136 @@
+#include "k-mismatches/kangaroo.h"
+#include "k-mismatches/naive.h"
+#include "k-mismatches/streamMatcher.h"
+
+#include <array>
+#include <cstdlib>
+#include <experimental/filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std::literals;
+
+/*
+    Randomized differential testing of the matching backends against NaiveQuery.
+    Each case is a text, either generated or cut from the lines of the files of a directory, a pattern, mostly a mutated piece of the text,
+    and a number of mismatches allowed. Stops at the first case where a backend differs from the reference, printing it.
+*/
+
+std::vector<std::string> loadLines(const std::experimental::filesystem::path& directory)
+{
+    std::vector<std::string> lines;
+    for (const std::experimental::filesystem::path& path : std::experimental::filesystem::directory_iterator(directory))
+    {
+        std::ifstream in(path);
+        for (std::string line; std::getline(in, line);)
+            if (!line.empty())
+                lines.push_back(line);
+    }
+
+    return lines;
+}
+
+int main(int argc, char* argv[])
+{
+    const std::vector<std::string> args(argv, argv + argc);
+    if (std::size(args) > 4)
+        return std::cerr << args[0] << " [<cases> [<seed> [<directory of real texts>]]]\n"s, EXIT_FAILURE;
+
+    const unsigned long
+        n_cases = std::size(args) > 1 ? std::stoul(args[1]) : 100000,
+        seed = std::size(args) > 2 ? std::stoul(args[2]) : std::random_device()();
+
+    const std::vector<std::string> lines(std::size(args) > 3 ? loadLines(args[3]) : std::vector<std::string>());
+    std::mt19937 random(seed);
+    const auto uniform([&](unsigned n){ return std::uniform_int_distribution<unsigned>(0, n - 1)(random); });
+
+    // Any byte but 0, which the suffix tree keeps for its terminator and which subtitles don't contain
+    const auto byte([&]{ return char(1 + uniform(ALPHABET_SIZE - 1)); });
+
+    for (unsigned long i_case = 0; i_case < n_cases; ++i_case)
+    {
+        // Small alphabets make for many near matches, a generated text's alphabet is a random set of bytes
+        std::string T;
+        if (!lines.empty() && uniform(2) == 0)
+        {
+            const unsigned i_line = uniform(unsigned(std::size(lines)));
+            for (unsigned i = i_line; i < std::size(lines) && std::size(T) < 400; ++i)
+                T += lines[i] + ' ';
+        }
+        else
+        {
+            std::vector<char> alphabet(1 + uniform(uniform(2) == 0 ? 4 : 255));
+            for (char& c : alphabet)
+                c = byte();
+
+            T.resize(uniform(300));
+            for (char& c : T)
+                c = alphabet[uniform(unsigned(std::size(alphabet)))];
+        }
+
+        std::string P;
+        const unsigned m = uniform(uniform(4) == 0 ? 8 : 40);
+        if (std::size(T) >= m && uniform(4) != 0)
+        {
+            P = T.substr(uniform(unsigned(std::size(T)) - m + 1), m);
+            for (unsigned n_mutations = uniform(m / 2 + 1); n_mutations != 0; --n_mutations)
+                P[uniform(m)] = T.empty() || uniform(2) == 0 ? byte() : T[uniform(unsigned(std::size(T)))];
+        }
+        else
+            for (unsigned j = 0; j < m; ++j)
+                P += T.empty() || uniform(2) == 0 ? byte() : T[uniform(unsigned(std::size(T)))];
+
+        const unsigned k = uniform(m + 3);
+
+        // The dense alphabet of the text alone, as the engine builds it from its corpus, so the pattern may have characters outside it
+        std::array<bool, ALPHABET_SIZE> used{};
+        for (unsigned char c : T)
+            used[c] = true;
+
+        const NaiveQuery reference(P);
+        const KangarooQuery kangaroo(P), denseKangaroo(P, Alphabet(used));
+        for (const auto& [name, backend] : {std::pair<const char*, const PreparedQuery*>{"kangaroo", &kangaroo}, {"kangaroo with a dense alphabet", &denseKangaroo}})
+            if (const std::optional<std::string> divergence = findDivergence(*backend, reference, T, k))
+            {
+                std::cout
+                    << "Case "s << i_case << " of seed "s << seed << ": "s << name << " differs from the reference\n"s
+                    << "k = "s << k << "\nP = '"s << P << "'\nT = '"s << T << "'\n"s
+                    << *divergence << '\n';
+
+                return EXIT_FAILURE;
+            }
+
+        // The stream matcher, given the text in pieces, reports the same alignments as matching the whole text
+        if (m == 0)
+            continue;
+
+        StreamMatcher streamMatcher;
+        streamMatcher.add(std::make_unique<const NaiveQuery>(P), k);
+        std::vector<StreamMatcher::Hit> hits;
+        for (unsigned i = 0; i < std::size(T);)
+        {
+            const unsigned n_piece = 1 + uniform(unsigned(std::size(T)) - i);
+            streamMatcher.push(std::string_view(T).substr(i, n_piece), hits);
+            i += n_piece;
+        }
+
+        const std::vector<Alignment> expected(reference.matchAll(T, k, true));
+        for (unsigned i = 0; i < std::max(std::size(hits), std::size(expected)); ++i)
+            if (i == std::size(hits) || i == std::size(expected) || hits[i].i != expected[i].i || hits[i].mismatches != expected[i].mismatches || hits[i].positions != expected[i].positions)
+            {
+                std::cout
+                    << "Case "s << i_case << " of seed "s << seed << ": the stream matcher differs from the reference\n"s
+                    << "k = "s << k << "\nP = '"s << P << "'\nT = '"s << T << "'\n"s
+                    << "hit "s << i << " found "s << (i < std::size(hits) ? "at "s + std::to_string(hits[i].i) + " with "s + std::to_string(hits[i].mismatches) + " mismatches"s : "nothing"s)
+                    << ", expected "s << (i < std::size(expected) ? describeAlignment(expected[i]) : "nothing"s) << '\n';
+
+                return EXIT_FAILURE;
+            }
+    }
+
+    std::cout << n_cases << " cases of seed "s << seed << " passed\n"s;
+}
@@ -0,0 +1,231 @@
+#include "wordIndex.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <numeric>
+#include <optional>
+#include <tuple>
+#include <unordered_set>
+#include <utility>
+
+// A query word with more postings than this in a file is taken for a stop word, whose postings are skipped where that doesn't change the results
+const static unsigned stopWordPostings = 1024;
+
+std::vector<std::pair<unsigned, unsigned>> findWords(std::string_view text)
+{
+    const auto isWordCharacter([](unsigned char c){ return std::isalnum(c) || c == '\''; });
+    std::vector<std::pair<unsigned, unsigned>> words;
+    for (unsigned i = 0; i < std::size(text);)
+    {
+        if (!isWordCharacter(text[i]))
+        {
+            ++i;
+            continue;
+        }
+
+        const unsigned i_begin = i;
+        while (i < std::size(text) && isWordCharacter(text[i]))
+            ++i;
+
+        words.emplace_back(i_begin, i - i_begin);
+    }
+
+    return words;
+}
+
+std::string normalizeWord(std::string_view word)
+{
+    std::string normalized(word);
+    for (char& c : normalized)
+        c = char(std::tolower((unsigned char)c));
+
+    return normalized;
+}
+
+std::shared_ptr<const WordIndex> indexWords(const std::list<Episode>& episodes)
+{
+    const auto index(std::make_shared<WordIndex>());
+    for (const Episode& episode : episodes)
+        for (unsigned i_subtitle = 0; i_subtitle < std::size(episode.subtitles); ++i_subtitle)
+        {
+            const std::string_view text(subtitleText(episode, i_subtitle));
+            const std::vector<std::pair<unsigned, unsigned>> words(findWords(text));
+            unsigned previousId = WordIndex::noWord;
+            for (unsigned i_word = 0; i_word < std::size(words); ++i_word)
+            {
+                const auto [it, inserted] = index->ids.emplace(normalizeWord(text.substr(words[i_word].first, words[i_word].second)), unsigned(std::size(index->postings)));
+                if (inserted)
+                {
+                    index->postings.emplace_back();
+                    index->words.push_back(it->first);
+                    index->episodes.push_back(0);
+                }
+
+                std::vector<WordIndex::Posting>& postings(index->postings[it->second]);
+                if (postings.empty() || postings.back().episode != &episode)
+                    ++index->episodes[it->second];
+
+                // The previous word's posting is still the last of its list
+                if (previousId != WordIndex::noWord)
+                    index->postings[previousId].back().nextId = it->second;
+
+                postings.push_back({&episode, i_subtitle, i_word, unsigned(std::size(words)), WordIndex::noWord});
+                previousId = it->second;
+            }
+        }
+
+    index->sortedIds.resize(std::size(index->words));
+    std::iota(std::begin(index->sortedIds), std::end(index->sortedIds), 0u);
+    std::sort(std::begin(index->sortedIds), std::end(index->sortedIds), [&](unsigned lhs, unsigned rhs){ return index->words[lhs] < index->words[rhs]; });
+    return index;
+}
+
+std::vector<QueryResult> searchWords(const Corpus& corpus, const std::string& query, const SearchOptions& options, const Deadline& deadline)
+{
+    std::vector<std::string> queryWords;
+    for (const auto& [i_word, n_word] : findWords(query))
+        queryWords.push_back(normalizeWord(std::string_view(query).substr(i_word, n_word)));
+
+    const unsigned
+        m = unsigned(std::size(queryWords)),
+        k = mismatchBudget(m, options);
+
+    std::vector<QueryResult> results;
+    if (m == 0 || !corpus.wordIndex)
+        return results;
+
+    std::unordered_set<const Episode*> scope;
+    if (isScoped(options))
+        for (const Episode* episode : scopedEpisodes(corpus, options))
+            scope.insert(episode);
+
+    const auto inScope([&](const WordIndex::Posting& posting)
+    {
+        const std::chrono::milliseconds time(posting.episode->subtitles[posting.i_subtitle].time_begin);
+        return (!isScoped(options) || scope.count(posting.episode) != 0) && time >= options.from && time < options.to;
+    });
+
+    for (const SubtitlesFile& file : corpus.files)
+    {
+        if (deadline.expired())
+            break;
+
+        if (isScoped(options) && std::none_of(std::cbegin(*file.episodes), std::cend(*file.episodes), [&](const Episode& episode){ return scope.count(&episode) != 0; }))
+            continue;
+
+        std::unordered_map<const Episode*, unsigned> episodeOrder;
+        std::vector<const Episode*> episodes;
+        for (const Episode& episode : *file.episodes)
+        {
+            episodeOrder.emplace(&episode, unsigned(std::size(episodes)));
+            episodes.push_back(&episode);
+        }
+
+        // The posting lists of the query's words, of which the longest are skipped, each counting as a match of every alignment
+        // An alignment needs at least m - k matches, so as long as fewer than m - k are skipped, every one has a vote from the others
+        std::vector<const std::vector<WordIndex::Posting>*> postings(m, nullptr);
+        for (unsigned j = 0; j < m; ++j)
+            if (const auto it_id(file.words->ids.find(queryWords[j])); it_id != std::end(file.words->ids))
+                postings[j] = &file.words->postings[it_id->second];
+
+        std::vector<unsigned> byLength(m);
+        std::iota(std::begin(byLength), std::end(byLength), 0u);
+        std::stable_sort(std::begin(byLength), std::end(byLength), [&](unsigned lhs, unsigned rhs){ return (postings[lhs] ? std::size(*postings[lhs]) : 0) > (postings[rhs] ? std::size(*postings[rhs]) : 0); });
+
+        unsigned n_skipped = 0;
+        for (unsigned j : byLength)
+            if (m > k + 1 + n_skipped && postings[j] && std::size(*postings[j]) > stopWordPostings)
+            {
+                postings[j] = nullptr;
+                ++n_skipped;
+            }
+
+        /*
+            Votes by alignment, an alignment being a subtitle and the index among its words of where the query's first word is aligned
+            (only the alignments that fall within the subtitle's words). Each posting list gives its alignments in order, so they're merged,
+            and each subtitle's alignments are gathered in order, those with enough votes being checked against its words.
+        */
+        using alignment_t = std::tuple<unsigned, unsigned, unsigned>;
+        const auto alignment([&](unsigned j, const WordIndex::Posting& posting){ return alignment_t{episodeOrder[posting.episode], posting.i_subtitle, posting.i_word - j}; });
+        const auto aligned([&](unsigned j, const WordIndex::Posting& posting){ return posting.i_word >= j && posting.i_word - j + m <= posting.n_words && inScope(posting); });
+
+        // Per posting list, the index of its next posting and the alignment of the one before it, none once it's exhausted
+        std::vector<unsigned> heads(m, 0);
+        std::vector<std::optional<alignment_t>> headAlignments(m);
+        const auto advance([&](unsigned j)
+        {
+            headAlignments[j].reset();
+            for (; postings[j] && heads[j] < std::size(*postings[j]) && !headAlignments[j]; ++heads[j])
+                if (const WordIndex::Posting& posting((*postings[j])[heads[j]]); aligned(j, posting))
+                    headAlignments[j] = alignment(j, posting);
+        });
+
+        for (unsigned j = 0; j < m; ++j)
+            advance(j);
+
+        std::vector<unsigned> candidates; // Of the current subtitle, the indices of the words where the alignments with enough votes start
+        const auto checkSubtitle([&](unsigned i_episode, unsigned i_subtitle)
+        {
+            const Episode& episode(*episodes[i_episode]);
+            const std::string_view text(subtitleText(episode, i_subtitle));
+            const std::vector<std::pair<unsigned, unsigned>> words(findWords(text));
+            std::vector<std::string> normalized;
+            for (const auto& [i_word, n_word] : words)
+                normalized.push_back(normalizeWord(text.substr(i_word, n_word)));
+
+            // The alignment with the fewest mismatches, the first of them if there's a tie
+            std::optional<QueryResult> best;
+            for (unsigned i_first : candidates)
+            {
+                QueryResult result{0, episode.name, {}, words[i_first].first, {}};
+                for (unsigned j = 0; j < m; ++j)
+                    if (normalized[i_first + j] != queryWords[j])
+                    {
+                        ++result.mismatches;
+                        result.mismatchPositions.push_back(j);
+                    }
+
+                if (result.mismatches <= k && (!best || result.mismatches < best->mismatches))
+                    best = std::move(result);
+            }
+
+            if (best)
+            {
+                best->subtitles = copySubtitles(episode, i_subtitle, i_subtitle);
+                results.push_back(std::move(*best));
+            }
+
+            candidates.clear();
+        });
+
+        std::pair<unsigned, unsigned> subtitle{0, 0};
+        for (;;)
+        {
+            std::optional<alignment_t> next;
+            for (const std::optional<alignment_t>& head : headAlignments)
+                if (head && (!next || *head < *next))
+                    next = head;
+
+            if (!candidates.empty() && (!next || std::make_pair(std::get<0>(*next), std::get<1>(*next)) != subtitle))
+                checkSubtitle(subtitle.first, subtitle.second);
+
+            if (!next)
+                break;
+
+            unsigned votes = 0;
+            for (unsigned j = 0; j < m; ++j)
+                if (headAlignments[j] == next)
+                {
+                    ++votes;
+                    advance(j);
+                }
+
+            subtitle = {std::get<0>(*next), std::get<1>(*next)};
+            if (votes + n_skipped + k >= m)
+                candidates.push_back(std::get<2>(*next));
+        }
+    }
+
+    return results;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "corpus.h"
+#include "search.h"
+
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// The words of a subtitles file's episodes, for searching by word rather than by character
+struct WordIndex
+{
+    // The id of no word, as the next word of a subtitle's last word
+    static constexpr unsigned noWord = ~0u;
+
+    struct Posting
+    {
+        const Episode* episode;
+        unsigned i_subtitle;
+        unsigned i_word; // Index of the word among the subtitle's words
+        unsigned n_words;
+        unsigned nextId; // Of the word after it in the subtitle, for completing the words following others without reading the text
+    };
+
+    std::unordered_map<std::string, unsigned> ids;
+    std::vector<std::vector<Posting>> postings; // By word id, in the order of the episodes and their subtitles
+
+    // For completing words
+    std::vector<std::string> words;    // By word id
+    std::vector<unsigned> episodes;    // By word id, the number of episodes with the word
+    std::vector<unsigned> sortedIds;   // The word ids in order of their words
+};
+
+// The words of text, as the index of each one's first character and its length, a word being a run of letters, digits and apostrophes
+std::vector<std::pair<unsigned, unsigned>> findWords(std::string_view text);
+
+// Words are compared ignoring case
+std::string normalizeWord(std::string_view word);
+
+std::shared_ptr<const WordIndex> indexWords(const std::list<Episode>& episodes);
+
+/*
+    The subtitles with the query's words in order, each subtitle's best alignment of the query's words with consecutive words of its own,
+    with at most the mismatch budget for the number of words of mismatched words. Words ignore case and the characters between them.
+    The offset of a result is that of its first word, and its mismatch positions are the indices of the mismatched words of the query.
+    Words count only where they are in the alignment, so the same words in another order, or apart, mismatch.
+    The alignments are found by merging the posting lists of the query's words in order, each occurrence of a query word voting for the alignment
+    it's part of, so the subtitles' text is only read for the subtitles with alignments that have enough votes. The posting lists of the commonest words
+    are left out of the vote where the other words' votes still find every alignment with few enough mismatches.
+*/
+std::vector<QueryResult> searchWords(const Corpus& corpus, const std::string& query, const SearchOptions& options, const Deadline& deadline);
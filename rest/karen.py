@@ -1,41 +1,245 @@
-import bottle, json, os, subprocess, sys
+import bottle, functools, itertools, json, os, subprocess, sys
 
 def formatTimestamp(milliseconds):
-    return f"{milliseconds // 3600000}:{milliseconds // 60000 % 60}:{milliseconds // 1000 % 60}.{milliseconds % 1000}"
+    return f"{milliseconds // 3600000}:{milliseconds // 60000 % 60}:{milliseconds // 1000 % 60}.{milliseconds % 1000:03}"
+
+def timeAt(subtitles, position):
+    # Interpolate the time of the byte at position in the subtitles' texts joined by spaces
+    for subtitle in subtitles:
+        n = len(subtitle['text'].encode())
+        if position <= n or subtitle is subtitles[-1]:
+            return subtitle['time_begin'] + (subtitle['time_end'] - subtitle['time_begin']) * min(position, n) // max(n, 1)
+        position -= n + 1
+
+def readResults(n_results, query):
+    ret = []
+    for _ in range(n_results):
+        similarity = float(karen.stdout.readline())
+        episodeName = karen.stdout.readline().strip()
+        offset, *mismatchPositions = map(int, karen.stdout.readline().split())
+        subtitles = []
+        for t in iter(lambda: karen.stdout.readline().rstrip('\n'), ''):
+            print(f"similarity = {similarity}, t = {episodeName}, {t}")
+            time_begin, time_end, text = t.split(', ', 2)
+            subtitles += [{'time_begin': int(time_begin), 'time_end': int(time_end), 'text': text}]
+
+        ret += [{
+            'similarity': similarity, 'episodeName': episodeName,
+            'time_begin': subtitles[0]['time_begin'], 'time_end': subtitles[-1]['time_end'], 'text': ' '.join(subtitle['text'] for subtitle in subtitles), 'subtitles': subtitles,
+            'offset': offset, 'mismatchPositions': mismatchPositions,
+            'clip_begin': timeAt(subtitles, offset), 'clip_end': timeAt(subtitles, offset + len(query.encode()))
+        }]
+
+    return ret
+
+class EngineError(Exception):
+    # The engine couldn't handle a request, as with invalid options
+    pass
+
+def readHeader():
+    # (the number of results, prefixed with '~' for a batch of streamed results, the flags) of a response
+    header = karen.stdout.readline()
+    if header.startswith('error '):
+        raise EngineError(header[len('error '):].rstrip('\n'))
+
+    n_results, *flags = header.split()
+    return n_results, flags
+
+def engineErrors(route):
+    # The engine's errors are the request's, so they're answered with 400 Bad Request
+    @functools.wraps(route)
+    def handle(*args, **kwargs):
+        try:
+            return route(*args, **kwargs)
+        except EngineError as e:
+            bottle.abort(400, str(e))
+
+    return handle
+
+def engineValue(name, value):
+    # A tab or line break in a value would end it, and what follows would be taken as more of the request, or as another request
+    if any(c in value for c in '\t\r\n'):
+        bottle.abort(400, f"Invalid {name} {value!r}")
+
+    return value
+
+def engineFlag(name, value):
+    # As the engine takes flags, checked here so that a search that would be streamed is refused before anything is
+    if value not in ['0', '1', 'true', 'false']:
+        bottle.abort(400, f"Invalid {name} {value!r}")
+
+    return value
+
+def engineQuery(query):
+    # Queries are text, in which tabs and line breaks are spaces
+    return query.translate(str.maketrans('\t\r\n', '   '))
+
+requestIds = itertools.count()
+
+def searchOptions():
+    # Search options passed through from the request, as (name, value) pairs, as episode may be given more than once
+    # verify is left to the engine's command line, as it checks every result with an O(nm) search per subtitle
+    flags = [(name, engineFlag(name, value)) for name in ['words', 'episode-text'] for value in bottle.request.GET.getall(name)]
+    return flags + [(name, engineValue(name, value)) for name in ['budget', 'mismatch-ratio', 'max-mismatches', 'min-similarity', 'scoring', 'episode', 'episode-pattern', 'from', 'to', 'session', 'limit'] for value in bottle.request.GET.getall(name)]
+
+def searchResponses(query, requestId, options):
+    # Yields (final, flags, results) for each batch of streamed results and then the final results
+    # The engine's error ends its response, even after batches, and is raised as EngineError
+    # The final results' flags may include 'truncated' (the search was cut short) and 'partial' (the corpus hasn't finished loading)
+    fields = [f'{name}={value}' for name, value in [('id', requestId), *options]] + [engineQuery(query)]
+    karen.stdin.write(':search\t' + '\t'.join(fields) + '\n')
+    karen.stdin.flush()
+    while True:
+        n_results, flags = readHeader()
+        if n_results.startswith('~'):
+            yield False, set(), readResults(int(n_results[1:]), query)
+        else:
+            yield True, set(flags), readResults(int(n_results), query)
+            return
+
+def cancel(requestId):
+    karen.stdin.write(f':cancel\t{requestId}\n')
+    karen.stdin.flush()
 
 @bottle.get()
+@engineErrors
 def search():
     print(dict(bottle.request.GET))
     bottle.response.content_type = 'application/json'
-    ret = []
-    karen.stdin.write(f'{bottle.request.GET.q}\n')
+    for _, flags, results in searchResponses(bottle.request.GET.q, next(requestIds), searchOptions()):
+        pass
+
+    if 'truncated' in flags:
+        bottle.response.set_header('X-Karen-Truncated', '1')
+
+    if 'partial' in flags:
+        bottle.response.set_header('X-Karen-Partial', '1')
+
+    return json.dumps(results)
+
+@bottle.get()
+def search_stream():
+    print(dict(bottle.request.GET))
+    bottle.response.content_type = 'application/x-ndjson'
+    requestId = next(requestIds)
+    responses = searchResponses(bottle.request.GET.q, requestId, [('stream', 1), *searchOptions()])
+    final = streamed = False
+    try:
+        for final, flags, results in responses:
+            yield json.dumps({'final': final, 'truncated': 'truncated' in flags, 'partial': 'partial' in flags, 'results': results}) + '\n'
+            streamed = True
+    except EngineError as e:
+        # Once results have been streamed, the status has been sent, so the error ends the stream instead
+        final = True
+        if not streamed:
+            bottle.abort(400, str(e))
+
+        yield json.dumps({'final': True, 'error': str(e)}) + '\n'
+    finally:
+        # If the client went away, stop the search and drain the rest of the engine's output
+        if not final:
+            cancel(requestId)
+            for _ in responses:
+                pass
+
+@bottle.get()
+@engineErrors
+def complete():
+    print(dict(bottle.request.GET))
+    bottle.response.content_type = 'application/json'
+    fields = [f"limit={engineValue('limit', bottle.request.GET.limit)}"] if bottle.request.GET.limit else []
+    karen.stdin.write(':complete\t' + '\t'.join(fields + [engineQuery(bottle.request.GET.q)]) + '\n')
     karen.stdin.flush()
-    n_results = int(karen.stdout.readline())
-    for _ in range(n_results):
-        subtitles = []
-        similarity = float(karen.stdout.readline())
-        episodeName = karen.stdout.readline().strip()
-        t = karen.stdout.readline().strip()
+    n_completions, flags = readHeader()
+    completions = []
+    for _ in range(int(n_completions)):
+        episodes = int(karen.stdout.readline())
+        completions += [{'completion': karen.stdout.readline().rstrip('\n'), 'episodes': episodes}]
         karen.stdout.readline()
-        print(f"similarity = {similarity}, t = {episodeName}, {t}")
-        time_begin, time_end, text = t.split(', ', 2)
-        ret += [{'similarity': similarity, 'episodeName': episodeName, 'time_begin': int(time_begin), 'time_end': int(time_end), 'text': text}]
 
-    return json.dumps(ret)
+    if 'truncated' in flags:
+        bottle.response.set_header('X-Karen-Truncated', '1')
+
+    if 'partial' in flags:
+        bottle.response.set_header('X-Karen-Partial', '1')
+
+    return json.dumps(completions)
+
+@bottle.get()
+@engineErrors
+def stats():
+    # The engine's estimated memory in bytes by component
+    bottle.response.content_type = 'application/json'
+    karen.stdin.write(':stats\n')
+    karen.stdin.flush()
+    n_components, flags = readHeader()
+    components = {}
+    for _ in range(int(n_components)):
+        size = int(karen.stdout.readline())
+        components[karen.stdout.readline().rstrip('\n')] = size
+        karen.stdout.readline()
+
+    return json.dumps(components)
+
+def subtitlesAt(episodeName, timestamp, context):
+    # (the subtitles showing at timestamp with context subtitles either side, the index of the first of them showing, how many are showing), None if there's no such episode
+    # If none are showing, the index is of the next subtitle
+    karen.stdin.write(f":at\tcontext={context}\tepisode={engineValue('episodeName', episodeName)}\t{timestamp}\n")
+    karen.stdin.flush()
+    n_episodes, flags = readHeader()
+    ret = None
+    for _ in range(int(n_episodes)):
+        n_showing = int(karen.stdout.readline())
+        karen.stdout.readline()
+        i_first = int(karen.stdout.readline())
+        subtitles = []
+        for t in iter(lambda: karen.stdout.readline().rstrip('\n'), ''):
+            time_begin, time_end, text = t.split(', ', 2)
+            subtitles += [{'time_begin': int(time_begin), 'time_end': int(time_end), 'text': text}]
+
+        ret = ret or (subtitles, i_first, n_showing)
+
+    return ret
+
+def requestTimestamp():
+    # With snap, the timestamp is moved to the beginning of the subtitle showing at it, or of the next one
+    timestamp = int(bottle.request.GET.timestamp)
+    if bottle.request.GET.snap:
+        at = subtitlesAt(bottle.request.GET.episodeName, timestamp, 1)
+        if at and at[1] < len(at[0]):
+            timestamp = at[0][at[1]]['time_begin']
+
+    return timestamp
+
+@bottle.get()
+@engineErrors
+def at():
+    print(dict(bottle.request.GET))
+    bottle.response.content_type = 'application/json'
+    found = subtitlesAt(bottle.request.GET.episodeName, int(bottle.request.GET.timestamp), int(bottle.request.GET.context or 2))
+    if found is None:
+        return json.dumps(None)
+
+    subtitles, i_first, n_showing = found
+    return json.dumps({'subtitles': subtitles, 'showing_begin': i_first, 'showing_end': i_first + n_showing})
 
 @bottle.get()
+@engineErrors
 def image():
     print(dict(bottle.request.GET))
     bottle.response.content_type = 'image/jpeg'
-    args = [f'ffmpeg', '-hide_banner', '-ss', f'{formatTimestamp(int(bottle.request.GET.timestamp))}', '-i', os.path.join(videoDirectory, f'{bottle.request.GET.episodeName}.avi'), '-vframes', '1', '-f', 'image2', '-']
+    args = [f'ffmpeg', '-hide_banner', '-ss', f'{formatTimestamp(requestTimestamp())}', '-i', os.path.join(videoDirectory, f'{bottle.request.GET.episodeName}.avi'), '-vframes', '1', '-f', 'image2', '-']
     print(' '.join(args))
     return subprocess.run(args, stdout = subprocess.PIPE).stdout
 
 @bottle.get()
+@engineErrors
 def video():
     print(dict(bottle.request.GET))
-    filename = f'{bottle.request.GET.episodeName}.{bottle.request.GET.timestamp}.webm'
-    args = [f'ffmpeg', '-hide_banner', '-ss', f'{formatTimestamp(int(bottle.request.GET.timestamp))}', '-i', os.path.join(videoDirectory, f'{bottle.request.GET.episodeName}.avi'), '-t', '0:0:10', '-vcodec', 'libvpx-vp9', '-acodec', 'libvorbis', '-preset', 'ultrafast', '-cpu-used', '-5', '-deadline', 'realtime', '-n', filename]
+    duration = int(bottle.request.GET.duration or 10000)
+    timestamp = requestTimestamp()
+    filename = f'{bottle.request.GET.episodeName}.{timestamp}.{duration}.webm'
+    args = [f'ffmpeg', '-hide_banner', '-ss', f'{formatTimestamp(timestamp)}', '-i', os.path.join(videoDirectory, f'{bottle.request.GET.episodeName}.avi'), '-t', f'{formatTimestamp(duration)}', '-vcodec', 'libvpx-vp9', '-acodec', 'libvorbis', '-preset', 'ultrafast', '-cpu-used', '-5', '-deadline', 'realtime', '-n', filename]
     print(' '.join(args))
     subprocess.run(args)
     return filename
@@ -51,11 +255,11 @@ def clear_cache():
 def video_url(filename):
     return bottle.static_file(filename, root = '')
 
-if len(sys.argv) != 5:
-    print("karen <karen filepath> <videos directory> <subtitles directory> <offsets filepath>")
+if len(sys.argv) < 5:
+    print("karen <karen filepath> <videos directory> <subtitles directory> <offsets filepath> [karen options...]")
     sys.exit(1)
 
-karenFilepath, videoDirectory, subtitleDirectory, offsetsFilepath = sys.argv[1:]
-karen = subprocess.Popen([karenFilepath, videoDirectory, subtitleDirectory, offsetsFilepath], stdin = subprocess.PIPE, stdout = subprocess.PIPE, universal_newlines = True)
+karenFilepath, videoDirectory, subtitleDirectory, offsetsFilepath = sys.argv[1:5]
+karen = subprocess.Popen([karenFilepath, videoDirectory, subtitleDirectory, offsetsFilepath, *sys.argv[5:]], stdin = subprocess.PIPE, stdout = subprocess.PIPE, universal_newlines = True)
 
 bottle.run(host = '0.0.0.0', port = 8000)
@@ -0,0 +1,182 @@
+import argparse, collections, json, queue, random, subprocess, sys, threading, time, urllib.error, urllib.parse, urllib.request
+
+# Replays a log of queries against the engine (through its standard input) or the REST server (through /search) and reports
+# the throughput, the latency percentiles and the rates of errors and of truncated results
+# The log has a request of the engine's protocol per line, either a plain query or a :search command, other lines are skipped
+
+def parseSearch(line):
+    # (options, query) of a search request, None if the line is some other command
+    if not line.startswith(':'):
+        return [], line
+
+    command, *fields = line[1:].split('\t')
+    if command != 'search':
+        return None
+
+    return [tuple(field.split('=', 1)) for field in fields[:-1]], fields[-1] if fields else ''
+
+class Outcome:
+    def __init__(self, latency, error = False, truncated = False, partial = False):
+        self.latency, self.error, self.truncated, self.partial = latency, error, truncated, partial
+
+class EngineTarget:
+    # The engine answers requests in order, so each response is that of the oldest request outstanding
+    # A request the engine couldn't handle is answered with an error header, its standard error (warnings and progress) isn't needed
+    def __init__(self, args):
+        self.process = subprocess.Popen(args, stdin = subprocess.PIPE, stdout = subprocess.PIPE, stderr = subprocess.DEVNULL)
+        self.outstanding = collections.deque()
+        self.lock = threading.Lock()
+        self.reader = threading.Thread(target = self.read, daemon = True)
+        self.reader.start()
+
+    def send(self, line, start, done):
+        with self.lock:
+            self.outstanding.append((start, done))
+            self.process.stdin.write((line + '\n').encode())
+            self.process.stdin.flush()
+
+    def answer(self, **flags):
+        with self.lock:
+            start, done = self.outstanding.popleft()
+
+        done(Outcome(time.perf_counter() - start, **flags))
+
+    def read(self):
+        # The response being read: its header's flags and the number of results still to come (counting their empty lines)
+        flags, n_results = None, 0
+        for line in self.process.stdout:
+            line = line.decode(errors = 'replace').rstrip('\n')
+            if flags is None:
+                if line.startswith('error '):
+                    self.answer(error = True)
+                    continue
+
+                count, *flags = line.split()
+                n_results = int(count.lstrip('~'))
+                if count.startswith('~'):
+                    flags = ['~']
+            elif not line:
+                n_results -= 1
+
+            if n_results == 0:
+                if '~' not in flags:
+                    self.answer(truncated = 'truncated' in flags, partial = 'partial' in flags)
+
+                flags = None
+
+    def close(self):
+        self.process.stdin.close()
+        self.process.wait()
+
+class RestTarget:
+    def __init__(self, url, n_workers):
+        self.url = url.rstrip('/') + '/search'
+        self.requests = queue.Queue()
+        self.workers = [threading.Thread(target = self.work, daemon = True) for _ in range(n_workers)]
+        for worker in self.workers:
+            worker.start()
+
+    def send(self, line, start, done):
+        self.requests.put((line, start, done))
+
+    def work(self):
+        while True:
+            line, start, done = self.requests.get()
+            options, query = parseSearch(line)
+            try:
+                with urllib.request.urlopen(self.url + '?' + urllib.parse.urlencode([('q', query), *options])) as response:
+                    json.load(response)
+                    done(Outcome(time.perf_counter() - start, truncated = response.headers.get('X-Karen-Truncated') == '1', partial = response.headers.get('X-Karen-Partial') == '1'))
+            except (urllib.error.URLError, OSError, ValueError):
+                done(Outcome(time.perf_counter() - start, error = True))
+
+    def close(self):
+        pass
+
+def arrivals(rate, shape):
+    # Offsets in seconds from the start at which requests arrive, rate per second on average
+    t = 0
+    while True:
+        yield t
+        t += random.expovariate(rate) if shape == 'poisson' else 1 / rate
+
+def percentile(sortedValues, p):
+    return sortedValues[min(len(sortedValues) - 1, int(p / 100 * len(sortedValues)))] if sortedValues else 0
+
+def replay(target, lines, concurrency, rate, shape, duration):
+    # Closed loop (at most concurrency requests outstanding) without a rate, open loop otherwise
+    # In open loop a request's latency is from when it was due, so a slow target isn't hidden by requests being sent late
+    outcomes = []
+    lock = threading.Lock()
+    slots = threading.Semaphore(concurrency)
+    n_sent = 0
+    finished = threading.Condition(lock)
+
+    def done(outcome):
+        with lock:
+            outcomes.append(outcome)
+            finished.notify_all()
+
+        if not rate:
+            slots.release()
+
+    start = time.perf_counter()
+    for line, t in zip(lines, arrivals(rate, shape) if rate else iter(lambda: None, 0)):
+        if duration and time.perf_counter() - start >= duration:
+            break
+
+        if rate:
+            time.sleep(max(0, start + t - time.perf_counter()))
+            target.send(line, start + t, done)
+        else:
+            slots.acquire()
+            target.send(line, time.perf_counter(), done)
+
+        n_sent += 1
+
+    with lock:
+        finished.wait_for(lambda: len(outcomes) == n_sent)
+
+    return outcomes, time.perf_counter() - start
+
+def report(outcomes, elapsed):
+    n = len(outcomes)
+    latencies = sorted(outcome.latency * 1000 for outcome in outcomes if not outcome.error)
+    rate = lambda count: f'{count} ({100 * count / max(n, 1):.2f}%)'
+    print(f'requests: {n} in {elapsed:.3f} s, {n / elapsed:.1f} per second')
+    print(f'errors: {rate(sum(outcome.error for outcome in outcomes))}, truncated: {rate(sum(outcome.truncated for outcome in outcomes))}, partial: {rate(sum(outcome.partial for outcome in outcomes))}')
+    if latencies:
+        print(f'latency (ms): mean {sum(latencies) / len(latencies):.3f}, ' + ', '.join(f'p{p} {percentile(latencies, p):.3f}' for p in [50, 90, 99, 99.9]) + f', max {latencies[-1]:.3f}')
+
+parser = argparse.ArgumentParser(description = 'Replays a query log against the engine or the REST server')
+parser.add_argument('log', help = 'the query log, a request of the engine protocol per line')
+parser.add_argument('--rest', metavar = 'URL', help = 'the REST server to send the searches to, as /search requests')
+parser.add_argument('--engine', nargs = argparse.REMAINDER, metavar = 'ARG', help = 'the engine command line to start and send the requests to (last)')
+parser.add_argument('--concurrency', type = int, default = 1, help = 'requests outstanding at once in closed loop, REST workers in open loop')
+parser.add_argument('--rate', type = float, default = 0, help = 'requests per second in open loop (closed loop if not given)')
+parser.add_argument('--arrivals', choices = ['poisson', 'uniform'], default = 'poisson', help = 'the spacing of requests in open loop')
+parser.add_argument('--repeat', type = int, default = 1, help = 'times to replay the log')
+parser.add_argument('--duration', type = float, default = 0, help = 'seconds after which no more requests are sent')
+args = parser.parse_args()
+if bool(args.rest) == bool(args.engine):
+    parser.error('expected one of --rest and --engine')
+
+with open(args.log, encoding = 'utf-8') as log:
+    lines = [line.rstrip('\n') for line in log if parseSearch(line.rstrip('\n')) is not None]
+
+if not lines:
+    sys.exit('No searches in the log')
+
+if args.engine:
+    target = EngineTarget(args.engine)
+
+    # Wait for the engine to load its corpus before starting the clock
+    loaded = threading.Event()
+    target.send(':complete', time.perf_counter(), lambda outcome: loaded.set())
+    loaded.wait()
+else:
+    target = RestTarget(args.rest, max(args.concurrency, 1))
+
+outcomes, elapsed = replay(target, (line for _ in range(args.repeat) for line in lines), max(args.concurrency, 1), args.rate, args.arrivals, args.duration)
+target.close()
+report(outcomes, elapsed)
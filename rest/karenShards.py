@@ -0,0 +1,64 @@
+import argparse, os, subprocess, sys, tempfile
+
+# Checks that the engine answers the same sharded (--shards) as in one process, on a corpus where every episode has the same subtitles,
+# so that every result of a search ties with one in each of the other episodes, and which of them a limit keeps is down to the order of ties
+
+subtitles = ['the krusty krab', 'is this the krusty krab', 'no this is patrick', 'the krusty krab is unfair']
+
+def formatTimestamp(milliseconds):
+    return f'{milliseconds // 3600000}:{milliseconds // 60000 % 60:02}:{milliseconds // 1000 % 60:02}.{milliseconds % 1000:03}'
+
+def episodeName(i, n_files):
+    # Named so that the order of the episodes' names, of their files' names and of the shards the files fall in all differ
+    return f'Episode {i * 7 % n_files:02} {chr(ord("z") - i)}'
+
+def writeCorpus(directory, n_files):
+    # A subtitles file per episode
+    os.makedirs(os.path.join(directory, 'subtitles'))
+    names = [episodeName(i, n_files) for i in range(n_files)]
+    for name in names:
+        with open(os.path.join(directory, 'subtitles', f'{name}.txt'), 'w', encoding = 'utf-8') as file:
+            for i, text in enumerate(subtitles):
+                file.write(f'{formatTimestamp(1000 + 3000 * i)}, {formatTimestamp(3500 + 3000 * i)}, {text}\n')
+
+    with open(os.path.join(directory, 'offsets.txt'), 'w', encoding = 'utf-8') as file:
+        file.writelines(f'{name}: 0\n' for name in names)
+
+def requests(n_files):
+    for query in ['the krusty krab', 'is this', 'patrick', 'the krusty krab is fair', 'k']:
+        for limit in [0, 1, 3, 5, 13]:
+            for options in ['', 'episode-text=1\t', 'words=1\t', 'session=s\t', 'max-mismatches=4\tmin-similarity=0.5\t']:
+                yield f':search\t{options}limit={limit}\t{query}'
+
+    yield ':complete\tlimit=3\tk'
+    yield f':at\tepisode={episodeName(1, n_files)}\t5000'
+    # Both match equally, and are listed in the order they're watched for rather than by name
+    yield ':watch\tid=b\tkrusty krab'
+    yield ':watch\tid=a\tthe krusty'
+    yield ':feed\tbegin=0\tend=1000\tthe krusty krab'
+
+def run(args, input):
+    return subprocess.run(args, input = input, stdout = subprocess.PIPE, stderr = subprocess.DEVNULL, universal_newlines = True, check = True).stdout
+
+parser = argparse.ArgumentParser(description = 'Checks that the engine answers the same sharded as in one process when results tie')
+parser.add_argument('karen', help = 'the engine executable')
+parser.add_argument('--files', type = int, default = 12, help = 'the number of subtitles files (and episodes) in the corpus')
+parser.add_argument('--shards', type = int, nargs = '+', default = [2, 3, 5], help = 'the numbers of shards to check')
+args = parser.parse_args()
+
+with tempfile.TemporaryDirectory() as directory:
+    writeCorpus(directory, args.files)
+    engine = [args.karen, directory, os.path.join(directory, 'subtitles'), os.path.join(directory, 'offsets.txt')]
+    input = ''.join(request + '\n' for request in requests(args.files))
+    expected = run(engine, input)
+    failed = False
+    for n_shards in args.shards:
+        output = run(engine + [f'--shards={n_shards}'], input)
+        if output != expected:
+            i_line = next((i for i, (lhs, rhs) in enumerate(zip(expected.split('\n'), output.split('\n'))) if lhs != rhs), min(expected.count('\n'), output.count('\n')))
+            print(f'{n_shards} shards: differs from one process at line {i_line + 1} of the output')
+            failed = True
+        else:
+            print(f'{n_shards} shards: same as one process')
+
+sys.exit(1 if failed else 0)
@@ -0,0 +1,87 @@
+import json, os, stat, sys, tempfile, types
+
+# Checks that karen.py ends a stream of search results with the engine's error when the engine fails after streaming some,
+# refuses the request outright when it fails before, and stays in step with the engine for the next request.
+# karen.py is run with a stand-in engine, and with a stand-in for bottle so that its routes can be called directly
+
+engine = '''#!/usr/bin/env python3
+import sys
+for line in sys.stdin:
+    if not line.startswith(':search'):
+        continue
+
+    query = line.rstrip('\\n').split('\\t')[-1]
+    if query == 'late':
+        sys.stdout.write('~1\\n1\\nEpisode\\n0\\n0, 900, late\\n\\nerror Failed late\\n')
+    elif query == 'early':
+        sys.stdout.write('error Failed early\\n')
+    else:
+        sys.stdout.write('0\\n')
+
+    sys.stdout.flush()
+'''
+
+class HTTPError(Exception):
+    def __init__(self, status, body):
+        super().__init__(status, body)
+        self.status = status
+
+class Query(dict):
+    # As bottle's query, its values are attributes, and getall gives those of a name that may be given more than once
+    def __getattr__(self, name):
+        return self.get(name, '')
+
+    def getall(self, name):
+        return [self[name]] if name in self else []
+
+def abort(status, body):
+    raise HTTPError(status, body)
+
+routes = {}
+bottle = types.ModuleType('bottle')
+bottle.request = types.SimpleNamespace(GET = Query())
+bottle.response = types.SimpleNamespace(content_type = None, set_header = lambda name, value: None)
+bottle.get = lambda path = None: lambda route: routes.setdefault(route.__name__, route)
+bottle.route = bottle.get
+bottle.abort = abort
+bottle.run = lambda **kwargs: None
+bottle.static_file = lambda *args, **kwargs: None
+sys.modules['bottle'] = bottle
+
+def call(route, **query):
+    # The route's status and its output's lines, streamed or not
+    bottle.request.GET = Query(query)
+    try:
+        output = routes[route]()
+        return 200, [json.loads(line) for line in output] if route == 'search_stream' else [json.loads(output)]
+    except HTTPError as e:
+        return e.status, []
+
+with tempfile.TemporaryDirectory() as directory:
+    engineFilepath = os.path.join(directory, 'engine.py')
+    with open(engineFilepath, 'w') as file:
+        file.write(engine)
+
+    os.chmod(engineFilepath, os.stat(engineFilepath).st_mode | stat.S_IXUSR)
+    karenFilepath = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'karen.py')
+    sys.argv = [karenFilepath, engineFilepath, directory, directory, directory]
+    with open(karenFilepath, encoding = 'utf-8') as file:
+        exec(compile(file.read(), karenFilepath, 'exec'), {'__name__': 'karen'})
+
+    checks = [
+        ('an error after a batch ends the stream', call('search_stream', q = 'late'), lambda status, lines: status == 200 and len(lines) == 2 and not lines[0]['final'] and len(lines[0]['results']) == 1 and lines[1] == {'final': True, 'error': 'Failed late'}),
+        ('an error before any batch refuses the stream', call('search_stream', q = 'early'), lambda status, lines: status == 400),
+        ('an error after a batch refuses a search that is not streamed', call('search', q = 'late'), lambda status, lines: status == 400),
+        ('the next search is answered', call('search', q = 'after'), lambda status, lines: status == 200 and lines == [[]]),
+    ]
+
+failed = False
+for description, (status, lines), check in checks:
+    if not check(status, lines):
+        print(f'Failed: {description}, got status {status} and {lines}')
+        failed = True
+
+if not failed:
+    print(f'{len(checks)} checks passed')
+
+sys.exit(1 if failed else 0)
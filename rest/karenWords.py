@@ -0,0 +1,110 @@
+import argparse, os, random, re, subprocess, sys, tempfile
+
+# Checks searching by word (words=1) against a reference written here, on a generated corpus in which 'the' is common enough to be a stop word,
+# and that a subtitle with the query's words in another order ranks below one with them in order
+
+vocabulary = ['krusty', 'krab', 'pizza', 'is', 'this', 'no', 'patrick', 'unfair', 'squidward', "it's", 'jellyfish', 'bikini', 'bottom', 'formula']
+
+def formatTimestamp(milliseconds):
+    return f'{milliseconds // 3600000}:{milliseconds // 60000 % 60:02}:{milliseconds // 1000 % 60:02}.{milliseconds % 1000:03}'
+
+def randomWord(rng):
+    return 'the' if rng.random() < 0.3 else rng.choice(vocabulary)
+
+def generateEpisodes(rng, n_episodes, n_subtitles):
+    # By name, each a list of subtitles' texts, the first two episodes having the same words in and out of order
+    episodes = {'In order': ['The Krusty Krab pizza!'], 'Out of order': ['pizza, the krab Krusty']}
+    for i in range(n_episodes):
+        episodes[f'Episode {i}'] = [' '.join(randomWord(rng) for _ in range(rng.randint(1, 10))) for _ in range(n_subtitles)]
+
+    return episodes
+
+def writeCorpus(directory, episodes):
+    # A subtitles file per episode
+    os.makedirs(os.path.join(directory, 'subtitles'))
+    for name, subtitles in episodes.items():
+        with open(os.path.join(directory, 'subtitles', f'{name}.txt'), 'w', encoding = 'utf-8') as file:
+            for i, text in enumerate(subtitles):
+                file.write(f'{formatTimestamp(1000 * i)}, {formatTimestamp(1000 * i + 900)}, {text}\n')
+
+    with open(os.path.join(directory, 'offsets.txt'), 'w', encoding = 'utf-8') as file:
+        file.writelines(f'{name}: 0\n' for name in episodes)
+
+def findWords(text):
+    return [(match.start(), match.group().lower()) for match in re.finditer(r"[A-Za-z0-9']+", text)]
+
+def referenceSearch(episodes, query, mismatchRatio):
+    # Sorted (mismatches, episode name, time, offset, mismatch positions) of each subtitle's first alignment with the fewest mismatches
+    queryWords = [word for _, word in findWords(query)]
+    m = len(queryWords)
+    k = min(int(mismatchRatio * m), 16)
+    results = []
+    for name, subtitles in episodes.items():
+        for i, text in enumerate(subtitles):
+            words = findWords(text)
+            best = None
+            for i_first in range(len(words) - m + 1):
+                positions = [j for j in range(m) if words[i_first + j][1] != queryWords[j]]
+                if len(positions) <= k and (best is None or len(positions) < len(best[4])):
+                    best = (len(positions), name, 1000 * i, words[i_first][0], positions)
+
+            if best:
+                results.append(best)
+
+    return sorted(results)
+
+def readResponses(output):
+    # Per response, the (similarity, episode name, time, offset, mismatch positions) of each result
+    lines = iter(output.split('\n'))
+    for header in lines:
+        if not header:
+            return
+
+        results = []
+        for _ in range(int(header.split()[0])):
+            similarity, name, offsetAndPositions = float(next(lines)), next(lines), list(map(int, next(lines).split()))
+            time = int(next(lines).split(', ')[0])
+            next(lines)
+            results.append((similarity, name, time, offsetAndPositions[0], offsetAndPositions[1:]))
+
+        yield results
+
+parser = argparse.ArgumentParser(description = 'Checks searching by word against a reference')
+parser.add_argument('karen', help = 'the engine executable')
+parser.add_argument('--queries', type = int, default = 200, help = 'the number of random queries')
+parser.add_argument('--seed', type = int, default = None, help = 'the seed of the corpus and queries')
+args = parser.parse_args()
+
+seed = args.seed if args.seed is not None else random.randrange(1 << 32)
+rng = random.Random(seed)
+episodes = generateEpisodes(rng, 4, 1000)
+queries = [('the krusty krab pizza', 0.75)]
+queries += [(' '.join(randomWord(rng) for _ in range(rng.randint(1, 8))), rng.choice([0.25, 0.5])) for _ in range(args.queries)]
+
+with tempfile.TemporaryDirectory() as directory:
+    writeCorpus(directory, episodes)
+    engine = [args.karen, directory, os.path.join(directory, 'subtitles'), os.path.join(directory, 'offsets.txt')]
+    input = ''.join(f':search\twords=1\tmismatch-ratio={ratio}\t{query}\n' for query, ratio in queries)
+    output = subprocess.run(engine, input = input, stdout = subprocess.PIPE, stderr = subprocess.DEVNULL, universal_newlines = True, check = True).stdout
+
+failed = False
+responses = list(readResponses(output))
+# A random subtitle may have the words in order too, and rank level with it
+similarity = {result[1]: result[0] for result in responses[0] if result[1] in ('In order', 'Out of order')}
+if similarity.get('In order') != responses[0][0][0] or similarity.get('Out of order', 1) >= similarity['In order']:
+    print(f"The same words out of order don't rank below them in order: {similarity}, the best {responses[0][0][0]}")
+    failed = True
+
+for (query, ratio), results in zip(queries, responses):
+    m = len(findWords(query))
+    expected = referenceSearch(episodes, query, ratio)
+    found = sorted((round((1 - similarity) * 17), name, time, offset, positions) for similarity, name, time, offset, positions in results)
+    if found != expected:
+        print(f"Seed {seed}: query '{query}' found {len(found)} results, the reference {len(expected)}, first differing: {next((pair for pair in zip(found, expected) if pair[0] != pair[1]), None)}")
+        failed = True
+        break
+
+if not failed:
+    print(f'{len(queries)} queries of seed {seed} passed')
+
+sys.exit(1 if failed else 0)